@@ -25,6 +25,34 @@ typedef struct
 #ifdef __cplusplus
 #include <TFT_eSPI.h>
 
+// Number of memoized string widths kept by TTFtextWidth
+#ifndef TTF_WIDTH_CACHE_SIZE
+#define TTF_WIDTH_CACHE_SIZE 16
+#endif
+
+// Decoded glyph header
+typedef struct
+{
+  uint16_t width;
+  uint16_t height;
+  int16_t xoffset;
+  int16_t yoffset;
+  uint16_t delta;
+} TTFglyph_t;
+
+// Text measurement, coordinates are relative to the cursor position (top of
+// the first line). The ink box is half open: x0 <= x < x1, y0 <= y < y1
+typedef struct
+{
+  int16_t x0;
+  int16_t y0;
+  int16_t x1;
+  int16_t y1;
+  int16_t ascent;   // ink rows above the first line's baseline
+  int16_t descent;  // ink rows below the last line's baseline
+  uint16_t advance; // widest line advance, same as TTFtextWidth
+} TTFmetrics_t;
+
 
 class TFT_eSPI_ext : public TFT_eSPI
 {
@@ -149,7 +177,8 @@ public:
 
     int16_t xoffset = fetchbits_signed(data, bitoffset, font->bits_xoffset);
     int16_t yoffset = fetchbits_signed(data, bitoffset, font->bits_yoffset);
-    uint32_t delta = fetchbits_unsigned(data, bitoffset, font->bits_delta);
+    uint32_t delta = fetchbits_unsigned(data, bitoffset, font->bits_delta) + embolden;
+    uint32_t inkwidth = width + embolden; // runs are widened by embolden pixels
 
     // A background cursor is maintained to keep track of the areas with background
     // this allows background to be drawn correctly for characters that overlap (e.g. italic).
@@ -172,7 +201,7 @@ public:
       origin_x = 0;
     }
 
-    if (origin_x + (int16_t)width > _width)
+    if (origin_x + (int16_t)inkwidth > _width)
     {
       if (!textwrapX)
         return;
@@ -205,7 +234,7 @@ public:
 
     int16_t linecount = height;
     uint32_t y = cursor_y + font->cap_height - height - yoffset;
-    int32_t bg_width = (origin_x  +  width) - bg_cursor_x;
+    int32_t bg_width = (origin_x  +  inkwidth) - bg_cursor_x;
 
     // Fill top section
     if (textcolor != textbgcolor) _dest->fillRect(bg_cursor_x, cursor_y, bg_width, y - cursor_y, textbgcolor);
@@ -247,57 +276,160 @@ public:
     if (textcolor != textbgcolor) _dest->fillRect(bg_cursor_x, y, bg_width, (cursor_y + font->line_space) - y, textbgcolor);
     if (_useTFT) _dest->endWrite();
 
-    bg_cursor_x = origin_x  +  width;
+    bg_cursor_x = origin_x  +  inkwidth;
   }
 
-// Measure the dimensions for a single character
-void TTFmeasureChar(unsigned char c, uint32_t* w, uint32_t* h) {
-	if (!font) return;
-
-  *h = font->cap_height;
-  *w = 0;
-
-  if (c == 0xa0) c = ' '; // Treat non-breaking space as normal space
+// Decode the header of glyph c in font f, returns false if the font has no such glyph
+bool TTFglyph(const tftfont_t *f, uint16_t c, TTFglyph_t *g)
+{
+  if (!f) return false;
 
   uint32_t bitoffset;
   const uint8_t *data;
 
-  if (c >= font->index1_first && c <= font->index1_last) {
-    bitoffset = c - font->index1_first;
-    bitoffset *= font->bits_index;
+  if (c >= f->index1_first && c <= f->index1_last) {
+    bitoffset = c - f->index1_first;
+    bitoffset *= f->bits_index;
   }
-  else if (c >= font->index2_first && c <= font->index2_last) {
-    bitoffset = c - font->index2_first + font->index1_last - font->index1_first + 1;
-    bitoffset *= font->bits_index;
+  else if (c >= f->index2_first && c <= f->index2_last) {
+    bitoffset = c - f->index2_first + f->index1_last - f->index1_first + 1;
+    bitoffset *= f->bits_index;
   }
-  else if (font->unicode) {
-    return; // TODO: implement sparse unicode
+  else if (f->unicode) {
+    return false; // TODO: implement sparse unicode
   }
   else {
-    return;
+    return false;
   }
 
-  data = font->data + fetchbits_unsigned(font->index, bitoffset, font->bits_index);
+  data = f->data + fetchbits_unsigned(f->index, bitoffset, f->bits_index);
   bitoffset = 0;
   uint32_t encoding = fetchbits_unsigned(data, bitoffset, 3);
 
-  if (encoding != 0) return;
-
-  //uint32_t width =
-  fetchbits_unsigned(data, bitoffset, font->bits_width);
-  //uint32_t height =
-  fetchbits_unsigned(data, bitoffset, font->bits_height);
-  //int16_t xoffset =
-  fetchbits_signed(data, bitoffset, font->bits_xoffset);
-  //int16_t yoffset =
-  fetchbits_signed(data, bitoffset, font->bits_yoffset);
-  uint32_t delta = fetchbits_unsigned(data, bitoffset, font->bits_delta);
-  *w = delta;
+  if (encoding != 0) return false;
+
+  g->width = fetchbits_unsigned(data, bitoffset, f->bits_width);
+  g->height = fetchbits_unsigned(data, bitoffset, f->bits_height);
+  g->xoffset = fetchbits_signed(data, bitoffset, f->bits_xoffset);
+  g->yoffset = fetchbits_signed(data, bitoffset, f->bits_yoffset);
+  g->delta = fetchbits_unsigned(data, bitoffset, f->bits_delta);
+  return true;
+}
+
+// Measure the dimensions for a single character
+void TTFmeasureChar(unsigned char c, uint32_t* w, uint32_t* h) {
+	if (!font) return;
+
+  *h = font->cap_height;
+  *w = 0;
+
+  if (c == 0xa0) c = ' '; // Treat non-breaking space as normal space
+
+  TTFglyph_t g;
+  if (!TTFglyph(font, c, &g)) return;
+  *w = g.delta + embolden;
+}
+
+// Measure the ink bounding box, ascent, descent and advance of a text string
+// using the glyph headers only, mirrors the placement done by drawFontChar
+// optional: - num =  max characters to process
+void TTFmeasureText(const char *text, TTFmetrics_t *m, int num = 0xffff)
+{
+  *m = {};
+  if (!font) return;
+
+  int32_t x = 0, top = 0;
+  int32_t x0 = INT16_MAX, y0 = INT16_MAX, x1 = INT16_MIN, y1 = INT16_MIN;
+  uint32_t maxAdvance = 0;
+  int i = 0;
+  char c;
+  while (i < num && (c = text[i]) != 0)
+  {
+    i++;
+    if (c == '\n')
+    {
+      if ((uint32_t)x > maxAdvance) maxAdvance = x;
+      x = 0;
+      top += font->line_space;
+      continue;
+    }
+
+    TTFglyph_t g;
+    if (!TTFglyph(font, (uint8_t)c == 0xa0 ? ' ' : (uint8_t)c, &g)) continue;
+
+    int32_t gx = x + g.xoffset;
+    if (gx < 0)
+    {
+      x -= g.xoffset;
+      gx = 0;
+    }
+    x += g.delta + embolden;
+    if (g.height == 0) continue;
+
+    int32_t gy = top + font->cap_height - g.height - g.yoffset;
+    if (gx < x0) x0 = gx;
+    if (gy < y0) y0 = gy;
+    if (gx + g.width + embolden > x1) x1 = gx + g.width + embolden;
+    if (gy + g.height > y1) y1 = gy + g.height;
+  }
+  if ((uint32_t)x > maxAdvance) maxAdvance = x;
+
+  m->advance = maxAdvance;
+  if (x1 == INT16_MIN) return; // no ink
+
+  m->x0 = x0;
+  m->y0 = y0;
+  m->x1 = x1;
+  m->y1 = y1;
+  m->ascent = font->cap_height - y0;
+  m->descent = y1 - (top + font->cap_height);
 }
 
 // Return the width of a text string
 // optional: - num =  max characters to process
+// Widths are memoized per (font, string hash, length) so repeated calls with
+// the same string skip the per-glyph header decode
 uint TTFtextWidth(const char *text, int num = 0xffff)
+{
+  if (!font) return 0;
+
+  uint32_t hash = 2166136261u ^ embolden; // FNV-1a, seeded so faux bold widths get their own entries
+  int len = 0;
+  while (len < num && text[len] != 0)
+  {
+    hash = (hash ^ (uint8_t)text[len]) * 16777619u;
+    len++;
+  }
+
+  TTFwidthCacheEntry &e = widthCache[hash % TTF_WIDTH_CACHE_SIZE];
+  if (e.font == font && e.hash == hash && e.len == len)
+  {
+    widthCacheHits++;
+    return e.width;
+  }
+  widthCacheMisses++;
+
+  uint w = TTFtextWidthUncached(text, len);
+  e.font = font;
+  e.hash = hash;
+  e.len = len;
+  e.width = w;
+  return w;
+}
+
+// Width cache statistics
+uint32_t TTFwidthCacheHits() { return widthCacheHits; }
+uint32_t TTFwidthCacheMisses() { return widthCacheMisses; }
+
+void TTFwidthCacheClear()
+{
+  for (int i = 0; i < TTF_WIDTH_CACHE_SIZE; i++) widthCache[i].font = nullptr;
+  widthCacheHits = 0;
+  widthCacheMisses = 0;
+}
+
+// Return the width of a text string without consulting the width cache
+uint TTFtextWidthUncached(const char *text, int num = 0xffff)
 {
   if (!font) return 0;
   uint maxH = 0;
@@ -342,6 +474,16 @@ uint16_t TTFtextHeight(const char *text, int num = 0xffff)
   return ((lines-1) * font->line_space + font->cap_height);
 }
 
+  // Synthesized bold, every glyph run is widened by k pixels and the advance by k,
+  // 0 turns it off. Lets a regular Arial size stand in for the _Bold tables
+  void setTTFEmbolden(uint8_t k) { embolden = k; }
+  uint8_t TTFembolden() { return embolden; }
+
+  // Font and colors in use, for callers that draw with their own and put them back
+  const tftfont_t *TTFfont() { return font; }
+  uint32_t TTFtextColor() { return textcolor; }
+  uint32_t TTFtextBgColor() { return textbgcolor; }
+
 	uint16_t TTFlineSpace() { return (font) ? font->line_space : 0; }
 	uint16_t TTFLineSpace() { return (font) ? font->line_space : 0; }
 
@@ -351,6 +493,20 @@ protected:
 
   int32_t bg_cursor_x;
   int32_t last_cursor_x = 0;
+  uint8_t embolden = 0;
+
+  // Direct mapped text width cache, TTF_WIDTH_CACHE_SIZE entries of 12 bytes
+  typedef struct
+  {
+    const tftfont_t *font;
+    uint32_t hash;
+    uint16_t len;
+    uint16_t width;
+  } TTFwidthCacheEntry;
+
+  TTFwidthCacheEntry widthCache[TTF_WIDTH_CACHE_SIZE] = {};
+  uint32_t widthCacheHits = 0;
+  uint32_t widthCacheMisses = 0;
 
 private:
   inline uint32_t fetchbit(const uint8_t *p, uint32_t &index)
@@ -383,6 +539,10 @@ private:
 
   void drawFontBits(uint32_t bits, uint32_t numbits, uint32_t x, uint32_t y, uint32_t repeat)
   {
+    // With embolden set each run is widened and runs that then touch are merged
+    // into one span, so the pending span is only written once it is complete
+    uint32_t span_x = 0, span_end = 0;
+
     bits <<= 32 - numbits; // left align bits
     do
     {
@@ -399,14 +559,34 @@ private:
           w = numbits;
         numbits -= w;
         bits <<= w;
-        _dest->setWindow(x, y, x + w - 1, y + repeat - 1); // write a block of pixels w x repeat sized
+        if (!embolden)
+        {
+          drawFontSpan(x, y, w, repeat);
+        }
+        else if (span_end > span_x && x <= span_end)
+        {
+          span_end = x + w + embolden;
+        }
+        else
+        {
+          if (span_end > span_x) drawFontSpan(span_x, y, span_end - span_x, repeat);
+          span_x = x;
+          span_end = x + w + embolden;
+        }
         x += w;
-        w *= repeat;
-
-        if (_useTFT) _dest->pushBlock(textcolor, w);
-        else while(w--) _dest->pushColor(textcolor);
       }
     } while (bits > 0 && numbits > 0);
+
+    if (span_end > span_x) drawFontSpan(span_x, y, span_end - span_x, repeat);
+  }
+
+  void drawFontSpan(uint32_t x, uint32_t y, uint32_t w, uint32_t repeat)
+  {
+    _dest->setWindow(x, y, x + w - 1, y + repeat - 1); // write a block of pixels w x repeat sized
+    w *= repeat;
+
+    if (_useTFT) _dest->pushBlock(textcolor, w);
+    else while(w--) _dest->pushColor(textcolor);
   }
 
 };
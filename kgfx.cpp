@@ -1,7 +1,43 @@
 #include <TFT_eSPI.h>
+#include <algorithm>
 
 #include "kgfx.h"
 
+#define FONT_SIZES 18
+#define FONT_FIRST_CHAR 32
+#define FONT_CHARS 95
+
+static const tftfont_t *const arialLadder[FONT_SIZES] = {
+  &Arial_8, &Arial_9, &Arial_10, &Arial_11, &Arial_12, &Arial_13, &Arial_14, &Arial_16, &Arial_18,
+  &Arial_20, &Arial_24, &Arial_28, &Arial_32, &Arial_40, &Arial_48, &Arial_60, &Arial_72, &Arial_96
+};
+
+// Only fitFontBold refers to the bold ladder, so the _Bold tables are left out of
+// builds that never ask for bold
+static const tftfont_t *const arialBoldLadder[FONT_SIZES] = {
+  &Arial_8_Bold, &Arial_9_Bold, &Arial_10_Bold, &Arial_11_Bold, &Arial_12_Bold, &Arial_13_Bold,
+  &Arial_14_Bold, &Arial_16_Bold, &Arial_18_Bold, &Arial_20_Bold, &Arial_24_Bold, &Arial_28_Bold,
+  &Arial_32_Bold, &Arial_40_Bold, &Arial_48_Bold, &Arial_60_Bold, &Arial_72_Bold, &Arial_96_Bold
+};
+
+// Sine over a quarter turn in Q14, 64 steps. Angles are binary, 65536 per turn
+static const int16_t sinTable[65] = {
+  0, 402, 804, 1205, 1606, 2006, 2404, 2801, 3196, 3590, 3981, 4370, 4756,
+  5139, 5520, 5897, 6270, 6639, 7005, 7366, 7723, 8076, 8423, 8765, 9102, 9434,
+  9760, 10080, 10394, 10702, 11003, 11297, 11585, 11866, 12140, 12406, 12665, 12916, 13160,
+  13395, 13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978, 15137, 15286, 15426, 15557,
+  15679, 15791, 15893, 15986, 16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379, 16384
+};
+
+// atan(i/64) as a binary angle, 8192 is 45 degrees
+static const uint16_t atanTable[65] = {
+  0, 163, 326, 489, 651, 813, 975, 1136, 1297, 1457, 1617, 1775, 1933,
+  2090, 2246, 2401, 2555, 2708, 2860, 3010, 3159, 3307, 3453, 3599, 3742, 3884,
+  4025, 4164, 4302, 4438, 4572, 4705, 4836, 4966, 5094, 5220, 5344, 5467, 5589,
+  5708, 5826, 5943, 6058, 6171, 6282, 6392, 6500, 6607, 6712, 6815, 6917, 7018,
+  7117, 7214, 7310, 7405, 7498, 7589, 7679, 7768, 7856, 7942, 8026, 8110, 8192
+};
+
 /***************************************************************************************
 ** Function name:           init
 ** Description:             Initializes GFX library
@@ -18,6 +54,7 @@ void KGFX::init() {
 void KGFX::clear() {
   t.fillScreen(TFT_BLACK);
   tft.fillScreen(TFT_BLACK);
+  invalidateChart();
 }
 
 /***************************************************************************************
@@ -46,6 +83,110 @@ TFT_eSprite KGFX::createSpriteLarge(int width, int height) {
   return spr;
 }
 
+/***************************************************************************************
+** Function name:           createTextSprite
+** Description:             Creates sprite sized to the ink of the given text
+***************************************************************************************/
+TFT_eSprite KGFX::createTextSprite(const char *txt, const tftfont_t &f) {
+  TTFmetrics_t m;
+  tft.setTTFFont(f);
+  tft.TTFmeasureText(txt, &m);
+
+  // Left side bearing is kept since the cursor cannot start left of the sprite
+  int w = m.x1 > 0 ? m.x1 : 1;
+  int h = m.y1 > m.y0 ? m.y1 - m.y0 : 1;
+  return createSprite(w, h);
+}
+
+/***************************************************************************************
+** Function name:           drawTextTight
+** Description:             Draws text to a sprite from createTextSprite, the text lands
+**                          at the same screen position as drawText at x, y
+***************************************************************************************/
+void KGFX::drawTextTight(TFT_eSprite &spr, const char *txt, const tftfont_t &f, int color, int x, int y) {
+  TTFmetrics_t m;
+  tft.TTFdestination(&spr);
+  spr.fillSprite(TFT_BLACK);
+
+  tft.setTTFFont(f);
+  tft.TTFmeasureText(txt, &m);
+  tft.setTextColor(color, TFT_BLACK);
+  tft.setCursor(0, -m.y0);
+  tft.print(txt);
+
+  spr.pushSprite(x, y + m.y0);
+}
+
+/***************************************************************************************
+** Function name:           fitFont
+** Description:             Returns the largest Arial size in which the text fits
+**                          maxWidth x maxHeight, or the smallest size if none fits
+***************************************************************************************/
+const tftfont_t &KGFX::fitFont(const char *txt, int maxWidth, int maxHeight) {
+  return fitFontLadder(txt, maxWidth, maxHeight, arialLadder, fontAdvances[K_ARIAL]);
+}
+
+/***************************************************************************************
+** Function name:           fitFontBold
+** Description:             fitFont over the Arial Bold sizes
+***************************************************************************************/
+const tftfont_t &KGFX::fitFontBold(const char *txt, int maxWidth, int maxHeight) {
+  return fitFontLadder(txt, maxWidth, maxHeight, arialBoldLadder, fontAdvances[K_ARIAL_BOLD]);
+}
+
+/***************************************************************************************
+** Function name:           fitFontLadder
+** Description:             Returns the largest font of the ladder in which the text fits,
+**                          adv holds the glyph advances of the ladder
+***************************************************************************************/
+const tftfont_t &KGFX::fitFontLadder(const char *txt, int maxWidth, int maxHeight,
+                                     const tftfont_t *const *ladder, std::vector<uint8_t> &adv) {
+  if (adv.empty()) {
+    // One time header decode of every glyph advance, FONT_SIZES * FONT_CHARS bytes
+    adv.resize(FONT_SIZES * FONT_CHARS);
+    for (int i=0;i<FONT_SIZES;i++) {
+      for (int c=0;c<FONT_CHARS;c++) {
+        TTFglyph_t g;
+        adv[i*FONT_CHARS + c] = tft.TTFglyph(ladder[i], c + FONT_FIRST_CHAR, &g) ? g.delta : 0;
+      }
+    }
+  }
+
+  int lines = 1;
+  for (const char *p = txt; *p; p++) {
+    if (*p == '\n') lines++;
+  }
+
+  int lo = 0, hi = FONT_SIZES - 1;
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    const tftfont_t *f = ladder[mid];
+    const uint8_t *a = &adv[mid*FONT_CHARS];
+
+    int w = 0, lineW = 0;
+    for (const char *p = txt; *p; p++) {
+      uint8_t c = *p == (char)0xa0 ? ' ' : *p;
+      if (c == '\n') {
+        lineW = 0;
+        continue;
+      }
+      if (c >= FONT_FIRST_CHAR && c < FONT_FIRST_CHAR + FONT_CHARS) {
+        lineW += a[c - FONT_FIRST_CHAR] + tft.TTFembolden();
+        if (lineW > w) w = lineW;
+      }
+    }
+    int h = (lines-1) * f->line_space + f->cap_height;
+
+    if (w <= maxWidth && h <= maxHeight) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  return *ladder[lo];
+}
+
 /***************************************************************************************
 ** Function name:           drawText
 ** Description:             Draws text to given sprite
@@ -108,11 +249,85 @@ void KGFX::drawTextCenter(const char *txt, const tftfont_t &f, int color, int y)
   tft.print(txt);
 }
 
+/***************************************************************************************
+ * Function name:           drawTextLines
+ * Description:             Draws multi-line text to given sprite with every line aligned
+ *                          on its own, sprite is centered on screen
+ ***************************************************************************************/
+void KGFX::drawTextLines(TFT_eSprite &spr, const char *txt, const tftfont_t &f, int color, int y, int align) {
+  tft.TTFdestination(&spr);
+  spr.fillSprite(TFT_BLACK);
+
+  tft.setTTFFont(f);
+  tft.setTextColor(color, TFT_BLACK);
+  printLines(txt, spr.width(), 0, align);
+
+  spr.pushSprite((tft.width() - spr.width())/2, y);
+}
+
+/***************************************************************************************
+ * Function name:           drawTextLines
+ * Description:             Draws multi-line text to screen with every line aligned on its own
+ ***************************************************************************************/
+void KGFX::drawTextLines(const char *txt, const tftfont_t &f, int color, int y, int align) {
+  tft.setTTFFont(f);
+  tft.setTextColor(color, TFT_BLACK);
+  printLines(txt, tft.width(), y, align);
+}
+
+/***************************************************************************************
+** Function name:           printLines
+** Description:             Prints text with the current font, aligning each line within
+**                          areaWidth. Line breaks and widths are found in a single pass,
+**                          lines past K_MAX_TEXT_LINES are dropped
+***************************************************************************************/
+void KGFX::printLines(const char *txt, int areaWidth, int y, int align) {
+  const char *start[K_MAX_TEXT_LINES];
+  int len[K_MAX_TEXT_LINES];
+  int width[K_MAX_TEXT_LINES];
+  int lines = 0;
+
+  start[0] = txt;
+  len[0] = 0;
+  width[0] = 0;
+  for (const char *p = txt; *p; p++) {
+    if (*p == '\n') {
+      if (lines == K_MAX_TEXT_LINES-1) break;
+      lines++;
+      start[lines] = p + 1;
+      len[lines] = 0;
+      width[lines] = 0;
+      continue;
+    }
+    uint32_t w, h;
+    tft.TTFmeasureChar(*p, &w, &h);
+    width[lines] += w;
+    len[lines]++;
+  }
+  lines++;
+
+  int lineSpace = tft.TTFLineSpace();
+  for (int i=0;i<lines;i++) {
+    int x = 0;
+    if (align == K_ALIGN_CENTER) {
+      x = (areaWidth - width[i])/2;
+    } else if (align == K_ALIGN_RIGHT) {
+      x = areaWidth - width[i];
+    }
+
+    tft.setCursor(x, y + i*lineSpace);
+    for (int j=0;j<len[i];j++) {
+      tft.write(start[i][j]);
+    }
+  }
+}
+
 /***************************************************************************************
 ** Function name:           createChartSprite
 ** Description:             Creates chart sprite
 ***************************************************************************************/
 void KGFX::createChartSprite() {
+  deleteChartSprite();
   chartSpr.setColorDepth(16);
   chartSpr.createSprite(240,80);
 }
@@ -122,10 +337,22 @@ void KGFX::createChartSprite() {
 ** Description:             Creates chart sprite with 8 bit colors
 ***************************************************************************************/
 void KGFX::createChartSpriteLarge(int x, int y) {
+  deleteChartSprite();
   chartSpr.setColorDepth(8);
   chartSpr.createSprite(x,y);
 }
 
+/***************************************************************************************
+** Function name:           createChartSpritePalette
+** Description:             Creates chart sprite with 4 bit palette colors, a quarter of
+**                          the 16 bit sprite memory. Colors are expanded at push time
+***************************************************************************************/
+void KGFX::createChartSpritePalette(int x, int y) {
+  deleteChartSprite();
+  chartSpr.setColorDepth(4);
+  chartSpr.createSprite(x,y);
+}
+
 /***************************************************************************************
 ** Function name:           deleteSprite
 ** Description:             Deletes given sprite
@@ -140,138 +367,2391 @@ void KGFX::deleteSprite(TFT_eSprite &spr) {
 ***************************************************************************************/
 void KGFX::deleteChartSprite() {
   chartSpr.deleteSprite();
+  invalidateChart();
+
+  // Bars are kept for updateLastBar to redraw into the next sprite
+  barSprDepth = 0;
+}
+
+/***************************************************************************************
+** Function name:           deleteBandSprite
+** Description:             Deletes the strip buffer drawChartBanded keeps between calls
+***************************************************************************************/
+void KGFX::deleteBandSprite() {
+  bandSpr.deleteSprite();
+}
+
+/***************************************************************************************
+** Function name:           pushChart
+** Description:             Pushes the chart sprite to row y of the screen. Only runs of the
+**                          columns marked dirty since the last push are sent, runs closer
+**                          than K_DIRTY_GAP merged into one window. A new position, size or
+**                          4 bit palette, or an invalidateChart, pushes it all
+***************************************************************************************/
+void KGFX::pushChart(int y) {
+  int w = chartSpr.width();
+  int h = chartSpr.height();
+  int bpp = chartSpr.getColorDepth();
+  bool full = !chartSpr.getPointer() || y != chartPushY || (int)chartDirty.size() != w
+    || (bpp == 4 && memcmp(chartPushPalette, palette, sizeof(palette)) != 0);
+
+  chartPushY = y;
+  memcpy(chartPushPalette, palette, sizeof(palette));
+  if (full) {
+    chartSpr.pushSprite(0, y);
+    chartDirty.assign(w, false);
+    return;
+  }
+
+  int x = 0;
+  while (x < w) {
+    if (!chartDirty[x]) { x++; continue; }
+    int x0 = x, x1 = x + 1;
+    for (x=x1;x<w && x-x1<K_DIRTY_GAP;x++) {
+      if (chartDirty[x]) x1 = x + 1;
+    }
+    chartSpr.pushSprite(x0, y, x0, 0, x1 - x0, h);
+    x = x1;
+  }
+  chartDirty.assign(w, false);
+}
+
+/***************************************************************************************
+** Function name:           markChartDirty
+** Description:             Marks columns x0 to x1 (exclusive) of the chart sprite for the
+**                          next push. Writes to other targets are not tracked
+***************************************************************************************/
+void KGFX::markChartDirty(int x0, int x1) {
+  if (chartTarget != &chartSpr) return;
+  x0 = std::max(x0, 0);
+  x1 = std::min(x1, (int)chartDirty.size());
+  for (int x=x0;x<x1;x++) {
+    chartDirty[x] = true;
+  }
+}
+
+/***************************************************************************************
+** Function name:           invalidateChart
+** Description:             Forgets what the chart sprite and the screen under it hold, for
+**                          when either was drawn over or the sprite recreated. The next
+**                          drawChartAppend redraws fully and the next chart push sends
+**                          the whole sprite
+***************************************************************************************/
+void KGFX::invalidateChart() {
+  chartSamples = 0;
+  chartLineColor = -1;
+  chartBottom.clear();
+  chartDirty.clear();
 }
 
 /***************************************************************************************
 ** Function name:           drawChart
 ** Description:             Draws default chart size to sprite
 ***************************************************************************************/
-void KGFX::drawChart(std::vector<float> arr, int color, int y, int spacing, int height) {
+void KGFX::drawChart(const std::vector<float> &arr, int color, int y, int spacing, int height) {
+  drawChartSpan(arr, color, y, spacing, height);
+}
+
+/***************************************************************************************
+** Function name:           drawChart
+** Description:             Draws the samples held by a ring buffer series, read in place
+**                          with its running min/max as the range
+***************************************************************************************/
+void KGFX::drawChart(const KGFXSeries &series, int color, int y, int spacing, int height) {
+  drawChartSpan(seriesSpan(series), color, y, spacing, height, &series);
+}
+
+/***************************************************************************************
+** Function name:           drawChartSpan
+** Description:             Draws the chart of a series of samples to the sprite
+***************************************************************************************/
+void KGFX::drawChartSpan(const KGFXSpan &arr, int color, int y, int spacing, int height,
+                         const KGFXSeries *series) {
   tft.TTFdestination(&chartSpr);
-  chartSpr.fillSprite(TFT_BLACK);
 
-  createPalette(color);
-  chartSpr.createPalette(palette);
+  fmtChartArray(arr, y, spacing, height);
+  if (series) addIndicators(*series, spacing);
+  renderChart(color, height);
+  chartScaleDrawn = chartScale;
+  chartSeries = series;
+  chartSeriesConfig = series ? series->config : 0;
+  chartSpacing = spacing;
+  chartSprWidth = chartSpr.width();
+  chartSprHeight = chartSpr.height();
+  chartSprDepth = chartSpr.getColorDepth();
 
-  int *fa = fmtChartArray(arr, height);
-  for (int i=0;i<(chartLen-2);i++) {
-    drawGraphLine(i*spacing, fa[i+1], (i+1)*spacing, fa[i+2], color);
-  }
+  pushChart(y);
+}
 
-  int multi = 5;
-  if (height>80) {
-    multi = height/13;
+/***************************************************************************************
+** Function name:           drawChartBanded
+** Description:             Draws the chart of drawChart without the chart sprite. The chart
+**                          is rasterized in bands of band rows into one small 16 bit sprite
+**                          as wide as the screen, each band pushed before the next is drawn
+***************************************************************************************/
+void KGFX::drawChartBanded(const std::vector<float> &arr, int color, int y, int spacing, int height, int band) {
+  drawChartBandedSpan(arr, color, y, spacing, height, band);
+}
+
+/***************************************************************************************
+** Function name:           drawChartBanded
+** Description:             drawChartBanded for a ring buffer series, read in place
+***************************************************************************************/
+void KGFX::drawChartBanded(const KGFXSeries &series, int color, int y, int spacing, int height, int band) {
+  drawChartBandedSpan(seriesSpan(series), color, y, spacing, height, band, &series);
+}
+
+/***************************************************************************************
+** Function name:           drawChartBandedSpan
+** Description:             Rasterizes the chart band by band, the band sprite is reused
+**                          while the screen width and band height stay the same
+***************************************************************************************/
+void KGFX::drawChartBandedSpan(const KGFXSpan &arr, int color, int y, int spacing, int height, int band,
+                               const KGFXSeries *series) {
+  int w = tft.width();
+  if (band < 1 || height < 1) return;
+  band = std::min(band, height);
+
+  if (!bandSpr.created() || bandSpr.width() != w || bandSpr.height() != band) {
+    bandSpr.deleteSprite();
+    bandSpr.setColorDepth(16);
+    if (!bandSpr.createSprite(w, band)) {
+      Serial.println("No memory: cannot create band sprite");
+      return;
+    }
   }
-  for (int i=0;i<240;i++) {
-    for (int j=0;j<height;j++) {
-      if (TFT_BLACK == chartSpr.readPixel(i, j) && (j>0 && TFT_BLACK != chartSpr.readPixel(i, j-1))) {
-        drawVGradient(i, j, multi);
-        break;
-      }
+
+  chartTarget = &bandSpr;
+  chartViewRows = height;
+  tft.TTFdestination(&bandSpr);
+
+  fmtChartArray(arr, y, spacing, height);
+  if (series) addIndicators(*series, spacing);
+  for (int top=0;top<height;top+=band) {
+    chartTargetTop = top;
+    if (top == 0) {
+      renderChart(color, height);
+    } else {
+      drawChartColumns(0, w, height);
     }
+    bandSpr.pushSprite(0, y + top, 0, 0, w, std::min(band, height - top));
   }
 
-  chartSpr.pushSprite(0, y);
+  chartTarget = &chartSpr;
+  chartTargetTop = 0;
+  chartViewRows = 0;
+
+  // Neither chartSpr nor the screen under it hold what they did
+  invalidateChart();
 }
 
 /***************************************************************************************
-** Function name:           drawChartWide
-** Description:             Draws default chart size that fills entire width to sprite
+** Function name:           drawChartAppend
+** Description:             Draws a chart whose series is the previously drawn one with one
+**                          sample appended, and the oldest dropped once the series no longer
+**                          grows. While the y-range and layout are unchanged the sprite is
+**                          shifted left and only the newest segment is drawn. Returns true
+**                          when the chart had to be fully redrawn
 ***************************************************************************************/
-void KGFX::drawChartWide(std::vector<float> arr, int color, int y) {
-  drawChart(arr, color, y, 8);
+bool KGFX::drawChartAppend(const std::vector<float> &arr, int color, int y, int spacing, int height) {
+  return drawChartAppendSpan(arr, color, y, spacing, height);
 }
 
 /***************************************************************************************
-** Function name:           drawChartLarge
-** Description:             Draws wide chart that default to 120 pixel height chart
+** Function name:           drawChartAppend
+** Description:             drawChartAppend for a ring buffer series after push(), the
+**                          samples are read in place through the wrap
 ***************************************************************************************/
-void KGFX::drawChartLarge(std::vector<float> arr, int color, int y, int height) {
-  drawChart(arr, color, y, 8, height);
+bool KGFX::drawChartAppend(const KGFXSeries &series, int color, int y, int spacing, int height) {
+  return drawChartAppendSpan(seriesSpan(series), color, y, spacing, height, &series);
 }
 
-void KGFX::createPalette(int color) {
-  if (color == K_GREEN) {
-    for (int i=0;i<15;i++) {
-      palette[i+1] = green_palette[i];
+/***************************************************************************************
+** Function name:           drawChartAppendSpan
+** Description:             Appends to the chart in the sprite, see drawChartAppend
+***************************************************************************************/
+bool KGFX::drawChartAppendSpan(const KGFXSpan &arr, int color, int y, int spacing, int height,
+                               const KGFXSeries *series) {
+  tft.TTFdestination(&chartSpr);
+
+  int samples = chartSamples;
+  float hi = chartHi, lo = chartLo, base = chartBase;
+  bool spaced = chartSpaced;
+  int scale = chartScaleDrawn;
+
+  int n = fmtChartArray(arr, y, spacing, height);
+  if (series) addIndicators(*series, spacing);
+  bool full = n < 2 || !spaced || !chartSpaced
+    || color != chartLineColor || spacing != chartSpacing || height != chartHeight
+    || hi != chartHi || lo != chartLo
+    || (chartSamples != samples && chartSamples != samples + 1)
+    || series != chartSeries || (series && series->config != chartSeriesConfig)
+    || scale != chartScale || (chartScale == K_SCALE_PERCENT && axisTicks > 0 && base != chartBase)
+    || chartSpr.width() != chartSprWidth || chartSpr.height() != chartSprHeight
+    || chartSpr.getColorDepth() != chartSprDepth;
+  chartScaleDrawn = chartScale;
+  chartSeries = series;
+  chartSeriesConfig = series ? series->config : 0;
+
+  if (full) {
+    renderChart(color, height);
+    chartSpacing = spacing;
+    chartSprWidth = chartSpr.width();
+    chartSprHeight = chartSpr.height();
+    chartSprDepth = chartSpr.getColorDepth();
+  } else {
+    if (chartSamples == samples) {
+      scrollChart(spacing);
+
+      // The first column still holds the end of the dropped segment
+      drawChartColumns(0, 1, height);
+
+      // Gridline dots stay on their screen columns, unless the scroll kept them in
+      // step the scrolled columns are redrawn on the tick rows
+      if (axisTicks > 0 && spacing % K_GRID_DOT != 0) {
+        for (int k=0;k<axisTicks;k++) {
+          chartClipTop = axisRow[k];
+          chartClipBottom = axisRow[k] + 1;
+          drawChartColumns(1, axisLeft - spacing, height);
+        }
+        chartClipTop = 0;
+        chartClipBottom = INT32_MAX;
+      }
+
+      // Tick labels stay at the right edge, the scrolled copy is redrawn
+      if (axisTicks > 0) {
+        drawChartColumns(axisLeft - spacing, chartSpr.width(), height);
+      }
     }
+    drawChartColumns(chartX[n-2], chartX[n-1] + 1, height);
+  }
+
+  pushChart(y);
+  return full;
+}
+
+/***************************************************************************************
+** Function name:           setChartAxis
+** Description:             Shows up to ticks y-axis ticks, dotted gridlines and right edge
+**                          labels on the line charts drawn next, 0 hides the axis
+***************************************************************************************/
+void KGFX::setChartAxis(int ticks) {
+  chartAxisTicks = std::max(0, std::min(ticks, K_MAX_TICKS));
+
+  // The sprite holds the old axis, the next drawChartAppend redraws fully
+  invalidateChart();
+}
+
+/***************************************************************************************
+** Function name:           drawSparklines
+** Description:             Draws every series as a small line chart in a grid of cols cells
+**                          per row filling the chart sprite, each scaled to its own range.
+**                          All series are normalized in one pass into shared point buffers,
+**                          then the cells are rasterized and the sprite is pushed once.
+**                          gradient fills below each line with the shades of color
+***************************************************************************************/
+void KGFX::drawSparklines(const std::vector<std::vector<float>> &series, int color, int y, int cols,
+                          bool gradient) {
+  const int one = 256;
+  int count = series.size();
+  if (count < 1 || cols < 1) {
+    Serial.println("No series: cannot draw sparklines");
     return;
   }
-  if (color == K_RED) {
-    for (int i=0;i<15;i++) {
-      palette[i+1] = red_palette[i];
-    }
+  tft.TTFdestination(&chartSpr);
+
+  int lines = (count + cols - 1) / cols;
+  int cellW = chartSpr.width() / cols;
+  int cellH = chartSpr.height() / lines;
+  int w = cellW - K_SPARK_GAP;
+  int rows = cellH - K_SPARK_GAP - K_CHART_LINE;
+  if (w < 2 || rows < 1) {
+    Serial.println("Cells too small: cannot draw sparklines");
     return;
   }
-}
 
-void KGFX::drawGraphLine(int x, int y, int x1, int y1, int pcolor) {
-  for (int i=0;i<3;i++) {
-    chartSpr.drawLine(x, y, x1, y1, pcolor);
+  invalidateChart();
+  bars.clear();
+  overlays = 0;
+  axisTicks = 0;
+
+  sparkIdx.clear();
+  sparkX.clear();
+  sparkY.clear();
+  sparkStart.assign(count + 1, 0);
+  for (int k=0;k<count;k++) {
+    const std::vector<float> &arr = series[k];
+    sparkStart[k] = sparkX.size();
+    if (arr.size() < 2) continue;
 
-    y++; y1++;
+    float lo, hi;
+    int s = sparkIdx.size();
+    decimateChart(arr, sparkIdx, w);
+    chartMinMax(arr, sparkIdx.data() + s, sparkIdx.size() - s, lo, hi);
+    setChartRange(lo, hi, rows);
+    mapChartPoints(arr, sparkIdx.data() + s, sparkIdx.size() - s, 0, sparkX, sparkY, w);
   }
-}
+  sparkStart[count] = sparkX.size();
 
-void KGFX::drawVGradient(int x, int y, int y1) {
-  int off = abs(y1 - y);
+  createPalette(color);
+  gradMaxIndex = 15;
+  chartSpr.createPalette(palette);
+  createBlendTable();
+  chartSpr.fillSprite(TFT_BLACK);
 
-  for (int i=3;i<=15;i++) {
-    for (int j = 0; j < y1; j++) {
-      if (off-- && off > 0) {
-        continue;
-      }
+  // Gradient bands scale with the cell as they do with the chart height
+  int multi = std::max(1, cellH / 13);
+  for (int k=0;k<count;k++) {
+    int x0 = (k % cols) * cellW;
+    int y0 = (k / cols) * cellH;
+    int s = sparkStart[k];
+    int n = sparkStart[k+1] - s;
+    int seg = 0;
+    for (int x=0;x<w;x++) {
+      int32_t top, bot;
+      if (!lineColumn(sparkX.data() + s, sparkY.data() + s, n, x, seg, top, bot)) continue;
+      bot += K_CHART_LINE * one;
 
-      if (y1 > 5) {
-          chartSpr.drawPixel(x, y, palette[8]);
-      } else {
-          chartSpr.drawPixel(x, y, palette[i]);
+      int r0 = top / one;
+      int r1 = (bot + one - 1) / one;
+      int qTop = ((std::min(bot, (r0+1) * one) - top) * K_CHART_AA_LEVELS + one/2) / one;
+      int qBot = ((bot - (r1-1) * one) * K_CHART_AA_LEVELS + one/2) / one;
+      int under = gradient ? gradientIndex(r1 - 1, multi) : 0;
+
+      chartVSpan(x0 + x, y0 + r0, y0 + r0 + 1, chartBlend[qTop][0]);
+      chartVSpan(x0 + x, y0 + r0 + 1, y0 + r1 - 1, chartColor(1));
+      chartVSpan(x0 + x, y0 + r1 - 1, y0 + r1, chartBlend[qBot][under]);
+      if (!gradient) continue;
+
+      // Fill down to the cell gap in runs of one palette entry
+      for (int r=r1;r<cellH - K_SPARK_GAP;) {
+        int idx = gradientIndex(r, multi);
+        int e = r + 1;
+        while (e < cellH - K_SPARK_GAP && gradientIndex(e, multi) == idx) e++;
+        if (idx) chartVSpan(x0 + x, y0 + r, y0 + e, chartColor(idx));
+        r = e;
       }
-      y++;
     }
   }
+
+  pushChart(y);
 }
 
-int* KGFX::fmtChartArray(std::vector<float> arr, int height) {
-  int multi = 1;
-  if (arr.size() < 30) {
-    Serial.println("Malformed array len: cannot fmt");
-    return nullptr;
+/***************************************************************************************
+** Function name:           setChartScale
+** Description:             Sets how line charts map values to rows: K_SCALE_LINEAR,
+**                          K_SCALE_LOG or K_SCALE_PERCENT. Percent charts keep the linear
+**                          shape and label the change from the first sample shown
+***************************************************************************************/
+void KGFX::setChartScale(int scale) {
+  chartScale = scale;
+}
+
+/***************************************************************************************
+** Function name:           seriesSpan
+** Description:             The samples of series to chart, its cached logs on a log scale.
+**                          The first log scale chart of a series starts its log cache
+***************************************************************************************/
+KGFXSpan KGFX::seriesSpan(const KGFXSeries &series) {
+  if (chartScale == K_SCALE_LOG) {
+    if (series.logs.empty()) series.fillLogs();
+    if (!series.logs.empty()) return series.logSpan();
   }
+  return series.span();
+}
 
-  float v = arr[0];
-  if (v >= 1000) {
-  } else {
-    if (v >= 10 && v < 1000) {
-      multi = 100;
-    } else {
-      multi = 10000;
+/***************************************************************************************
+** Function name:           setChartAutoRange
+** Description:             Pads the y-range of line charts by headroom times the data span
+**                          on each side and keeps it until the data leaves it, or until the
+**                          data needs less than 1/(1+hysteresis) of it. Most updates then
+**                          keep the range, so drawChartAppend can stay incremental. Each
+**                          chart holds its own range, charts told apart by their screen row
+***************************************************************************************/
+void KGFX::setChartAutoRange(bool on, float headroom, float hysteresis) {
+  autoRange = on;
+  autoHeadroom = std::max(0.0f, headroom);
+  autoHysteresis = std::max(0.0f, hysteresis);
+  for (int i=0;i<K_CHART_RANGES;i++) {
+    chartRanges[i].held = false;
+  }
+}
+
+/***************************************************************************************
+** Function name:           chartRangeChanged
+** Description:             True when the last line chart drawn had a different y-range or
+**                          height than when it was last drawn at its screen row, so every
+**                          point moved
+***************************************************************************************/
+bool KGFX::chartRangeChanged() {
+  return chartRescaled;
+}
+
+/***************************************************************************************
+** Function name:           drawChartOverlay
+** Description:             Draws up to K_MAX_SERIES series into one chart, series[0] with
+**                          the line and gradient of drawChart and the others as plain lines
+**                          over it in their colors. sharedRange scales every series to the
+**                          y-range of all of them, otherwise each to its own. Scale and
+**                          auto-range apply as they do to drawChart. The sprite is
+**                          rasterized in one pass and pushed once
+***************************************************************************************/
+void KGFX::drawChartOverlay(const std::vector<std::vector<float>> &series, const std::vector<int> &colors,
+                            int y, bool sharedRange, int spacing, int height) {
+  int count = std::min(std::min(series.size(), colors.size()), (size_t)K_MAX_SERIES);
+  if (count < 1) {
+    Serial.println("No series: cannot draw overlay chart");
+    return;
+  }
+  tft.TTFdestination(&chartSpr);
+
+  // Overlays are picked first so the shared range covers all of them when the
+  // primary series sets up chartX/chartY
+  bool logs = chartScale == K_SCALE_LOG;
+  float lo = INFINITY, hi = -INFINITY;
+  overlayIdx.clear();
+  int pickStart[K_MAX_SERIES];
+  for (int k=1;k<count;k++) {
+    const std::vector<float> &arr = series[k];
+    pickStart[k-1] = overlayIdx.size();
+    if (arr.size() < 2) continue;
+    decimateChart(arr, overlayIdx);
+    if (sharedRange) {
+      float l, u;
+      chartValueRange(arr, overlayIdx.data() + pickStart[k-1], overlayIdx.size() - pickStart[k-1], logs, l, u);
+      lo = l < lo ? l : lo;
+      hi = u > hi ? u : hi;
+    }
+  }
+  pickStart[count-1] = overlayIdx.size();
+
+  int rows = chartLineRows(height);
+  int n = fmtChartArray(series[0], y, spacing, height, lo, hi);
+  if (sharedRange && n == 0) {
+    chartRescaled = fitChartRange(y, 0, lo, hi, rows);
+  }
+  float primaryLo = chartLo, primaryHi = chartHi;
+
+  for (int k=1;k<count;k++) {
+    int s = pickStart[k-1], m = pickStart[k] - s;
+    overlayStart[k-1] = overlayX.size();
+    overlayColor[k-1] = colors[k];
+    if (m == 0) continue;
+    if (!sharedRange) {
+      chartValueRange(series[k], overlayIdx.data() + s, m, logs, lo, hi);
+      if (fitChartRange(y, k, lo, hi, rows)) chartRescaled = true;
     }
+    mapChartPoints(series[k], overlayIdx.data() + s, m, spacing, overlayX, overlayY, 0, logs);
+  }
+  overlayStart[count-1] = overlayX.size();
+  overlays = count - 1;
+
+  // Axis ticks follow the range of the primary series
+  if (!sharedRange) {
+    setChartRange(primaryLo, primaryHi, n > 0 ? rows : 0);
+  }
+
+  renderChart(colors[0], height);
+
+  // Overlays are not tracked by drawChartAppend, the next append redraws fully
+  invalidateChart();
+
+  pushChart(y);
+}
+
+/***************************************************************************************
+** Function name:           drawCandles
+** Description:             Draws an open/high/low/close candle chart to the chart sprite.
+**                          Candles are spacing pixels apart, when they do not fit the sprite
+**                          width consecutive candles are merged. Wicks are 1 pixel spans and
+**                          bodies filled spans, green when close >= open and red otherwise
+***************************************************************************************/
+void KGFX::drawCandles(const std::vector<float> &open, const std::vector<float> &high,
+                       const std::vector<float> &low, const std::vector<float> &close,
+                       int y, int spacing, int height) {
+  int n = std::min(std::min(open.size(), high.size()), std::min(low.size(), close.size()));
+  int width = chartSpr.width();
+
+  invalidateChart();
+  bars.clear();
+
+  chartSpr.fillSprite(TFT_BLACK);
+  if (n < 1 || spacing < 1 || height < 2) {
+    pushChart(y);
+    return;
   }
 
-  int hi = arr[0] * multi;
-  int lo = arr[0] * multi;
+  createPalette(K_GREEN);
+  palette[2] = K_RED;
+  chartSpr.createPalette(palette);
+
+  int count = n;
+  if (n * spacing > width) {
+    count = std::max(1, width / spacing);
+  }
 
-  for(int i=1;i<chartLen;i++) {
-    int v = arr[i] * multi;
-    if (v > hi) {
-      hi = v;
+  // Merge and normalize in one pass, bucket b holds samples b*n/count to (b+1)*n/count
+  candles.resize(count * 4);
+  float lo = INFINITY, hi = -INFINITY;
+  for (int b=0;b<count;b++) {
+    int s = (long)b*n/count;
+    int e = (long)(b+1)*n/count;
+    float h = -INFINITY, l = INFINITY;
+    for (int i=s;i<e;i++) {
+      h = std::max(h, std::max(high[i], std::max(open[i], close[i])));
+      l = std::min(l, std::min(low[i], std::min(open[i], close[i])));
     }
-    if (v < lo) {
-      lo = v;
+    float *c = &candles[b*4];
+    c[0] = open[s];
+    c[1] = h;
+    c[2] = l;
+    c[3] = close[e-1];
+    lo = std::min(lo, l);
+    hi = std::max(hi, h);
+  }
+  setChartRange(lo, hi, height - 1);
+
+  int bw = spacing > 2 ? spacing - 1 : spacing;
+  for (int b=0;b<count;b++) {
+    const float *c = &candles[b*4];
+    uint32_t color = chartColor(c[3] >= c[0] ? 1 : 2);
+    int x = b * spacing;
+
+    // Candles with a missing price are left out
+    if (!isfinite(c[0]) || !isfinite(c[1]) || !isfinite(c[2]) || !isfinite(c[3])) continue;
+
+    int rh = (chartRow(c[1]) + 128) >> 8;
+    int rl = (chartRow(c[2]) + 128) >> 8;
+    chartVSpan(x + (bw-1)/2, rh, rl + 1, color);
+
+    int ro = (chartRow(c[0]) + 128) >> 8;
+    int rc = (chartRow(c[3]) + 128) >> 8;
+    for (int i=0;i<bw;i++) {
+      chartVSpan(x + i, std::min(ro, rc), std::max(ro, rc) + 1, color);
     }
   }
 
-  int h = 50;
-  if (height > 80) {
-    h = (height/5)*4;
+  pushChart(y);
+}
+
+/***************************************************************************************
+** Function name:           drawBars
+** Description:             Draws a bar chart to the chart sprite. Bars are spacing pixels
+**                          apart and grow up or down from the zero baseline in posColor or
+**                          negColor. When they do not fit the sprite width consecutive
+**                          values are merged, keeping the one furthest from zero
+***************************************************************************************/
+void KGFX::drawBars(const std::vector<float> &arr, int y, int spacing, int height, int posColor, int negColor) {
+  int n = arr.size();
+  int width = chartSpr.width();
+
+  invalidateChart();
+
+  bars.clear();
+  if (n < 1 || spacing < 1 || height < 2) {
+    chartSpr.fillSprite(TFT_BLACK);
+    pushChart(y);
+    return;
+  }
+
+  palette[1] = posColor;
+  palette[2] = negColor;
+  chartSpr.createPalette(palette);
+
+  int count = n;
+  if (n * spacing > width) {
+    count = std::max(1, width / spacing);
+  }
+
+  // Merge and normalize in one pass, the baseline is always in range
+  bars.resize(count);
+  float lo = 0, hi = 0;
+  for (int b=0;b<count;b++) {
+    int s = (long)b*n/count;
+    int e = (long)(b+1)*n/count;
+    float v = arr[s];
+    for (int i=s+1;i<e;i++) {
+      if (fabsf(arr[i]) > fabsf(v)) v = arr[i];
+    }
+    bars[b] = v;
+    lo = std::min(lo, v);
+    hi = std::max(hi, v);
   }
+  setChartRange(lo, hi, height - 1);
 
-  int diff = hi - lo;
-  for(int i=0;i<chartLen;i++) {
-    int v = arr[i] * multi;
-    fa[i] = h-round(((v-lo) *h)/diff);
+  barSpacing = spacing;
+  barHeight = height;
+  barY = y;
+  barSprWidth = width;
+  barSprHeight = chartSpr.height();
+  barSprDepth = chartSpr.getColorDepth();
+
+  for (int b=0;b<count;b++) {
+    drawBar(b);
+  }
+  // Columns right of the last bar
+  for (int x=count*spacing;x<width;x++) {
+    chartVSpan(x, 0, chartSpr.height(), chartColor(0));
   }
 
-  return fa;
+  pushChart(y);
+}
+
+/***************************************************************************************
+** Function name:           updateLastBar
+** Description:             Changes the value of the last bar drawn by drawBars. While the
+**                          value stays in the current range only that bar is redrawn, and
+**                          pushChart sends just its columns, otherwise the whole chart is
+**                          rescaled. A chart sprite recreated since drawBars is redrawn
+**                          with all bars
+***************************************************************************************/
+void KGFX::updateLastBar(float v) {
+  if (bars.empty() || !chartSpr.created()) return;
+
+  int b = bars.size() - 1;
+  bars[b] = v;
+  if ((isfinite(v) && !(v >= chartLo && v <= chartHi)) || chartSpr.width() != barSprWidth
+      || chartSpr.height() != barSprHeight || chartSpr.getColorDepth() != barSprDepth) {
+    std::vector<float> arr = bars;
+    drawBars(arr, barY, barSpacing, barHeight, palette[1], palette[2]);
+    return;
+  }
+
+  drawBar(b);
+  pushChart(barY);
+}
+
+/***************************************************************************************
+** Function name:           drawBar
+** Description:             Writes every pixel of the columns of bar b, the bar as one span
+**                          from the baseline and black above and below it
+***************************************************************************************/
+void KGFX::drawBar(int b) {
+  int h = chartSpr.height();
+  int bw = barSpacing > 2 ? barSpacing - 1 : barSpacing;
+  int x = b * barSpacing;
+
+  int r0 = (chartRow(0) + 128) >> 8;
+  int rv = (chartRow(bars[b]) + 128) >> 8;
+  int top = std::min(r0, rv);
+  int bottom = std::max(r0, rv) + 1;
+  if (!isfinite(bars[b])) {
+    // A missing value has no bar, not even the baseline
+    top = bottom = r0;
+  }
+  uint32_t color = chartColor(bars[b] >= 0 ? 1 : 2);
+
+  for (int i=0;i<bw;i++) {
+    chartVSpan(x + i, 0, top, chartColor(0));
+    chartVSpan(x + i, top, bottom, color);
+    chartVSpan(x + i, bottom, h, chartColor(0));
+  }
+  for (int i=bw;i<barSpacing;i++) {
+    chartVSpan(x + i, 0, h, chartColor(0));
+  }
+}
+
+/***************************************************************************************
+** Function name:           renderChart
+** Description:             Draws the formatted chart points, line and gradient, to the
+**                          cleared chart sprite
+***************************************************************************************/
+void KGFX::renderChart(int color, int height) {
+  bars.clear();
+
+  createPalette(color);
+  for (int k=0;k<overlays;k++) {
+    palette[15-k] = overlayColor[k];
+  }
+  gradMaxIndex = 15 - overlays;
+  if (chartBandFill >= 0) {
+    palette[gradMaxIndex--] = (chartBandFill >> 2) & 0x39E7; // quarter intensity
+  }
+  chartTarget->createPalette(palette);
+  createBlendTable();
+  updateChartAxis();
+
+  chartBottom.assign(chartTarget->width(), -1);
+  drawChartColumns(0, chartTarget->width(), height);
+
+  chartLineColor = color;
+  chartHeight = height;
+}
+
+/***************************************************************************************
+** Function name:           drawChartColumns
+** Description:             Rasterizes columns x0 to x1 (exclusive) of the chart straight into
+**                          the sprite buffer. Every pixel of a column is written once: black
+**                          above the line, the anti-aliased line, then the gradient below it
+***************************************************************************************/
+void KGFX::drawChartColumns(int x0, int x1, int height) {
+  const int one = 256; // chartY rows are in 1/256 pixel fixed point
+  int w = chartTarget->width();
+  int h = chartViewHeight();
+  int n = chartX.size();
+
+  int multi = 5;
+  if (height>80) {
+    multi = height/13;
+  }
+  if (x0 < 0) x0 = 0;
+  if (x1 > w) x1 = w;
+
+  const uint16_t *grad = gradientColumn(multi);
+
+  int seg = 0;
+  int overlaySeg[K_MAX_OVERLAYS] = {0};
+  int bandSeg[2] = {0};
+  for (int x=x0;x<x1;x++) {
+    int32_t top, bot;
+    chartBottom[x] = -1;
+    if (!lineColumn(chartX.data(), chartY.data(), n, x, seg, top, bot)) {
+      chartVSpan(x, 0, h, chartColor(0));
+      drawBandColumn(x, -1, -1, height, multi, bandSeg);
+      drawGridColumn(x, -1, -1, height, multi);
+      drawOverlayColumn(x, overlaySeg);
+      drawLabelColumn(x);
+      continue;
+    }
+    bot += K_CHART_LINE * one;
+
+    int r0 = top >= 0 ? top / one : -((-top + one - 1) / one);
+    int r1 = (bot + one - 1) / one;
+
+    // Edge rows are blended by coverage, over black at the top and over the
+    // gradient at the bottom, the line is at least K_CHART_LINE rows so they differ
+    int qTop = ((std::min(bot, (r0+1) * one) - top) * K_CHART_AA_LEVELS + one/2) / one;
+    int qBot = ((bot - (r1-1) * one) * K_CHART_AA_LEVELS + one/2) / one;
+    int under = r1 - 1 < height ? gradientIndex(r1 - 1, multi) : 0;
+
+    chartVSpan(x, 0, r0, chartColor(0));
+    chartVSpan(x, r0, r0 + 1, chartBlend[qTop][0]);
+    chartVSpan(x, r0 + 1, r1 - 1, chartColor(1));
+    chartVSpan(x, r1 - 1, r1, chartBlend[qBot][under]);
+
+    chartBottom[x] = r1;
+    if (r1 > 0 && r1 < height) {
+      chartVCopy(x, r1, h, grad);
+    } else {
+      chartVSpan(x, r1, h, chartColor(0));
+    }
+    drawBandColumn(x, r0, r1, height, multi, bandSeg);
+    drawGridColumn(x, r0, r1, height, multi);
+    drawOverlayColumn(x, overlaySeg);
+    drawLabelColumn(x);
+  }
+}
+
+/***************************************************************************************
+** Function name:           drawGridColumn
+** Description:             Draws the gridline dots of column x where the column shows black,
+**                          so gridlines stay under the line and gradient. r0 to r1 are the
+**                          line rows of the column, -1 when it has no line
+***************************************************************************************/
+void KGFX::drawGridColumn(int x, int r0, int r1, int height, int multi) {
+  if (axisTicks == 0 || x % K_GRID_DOT != 0) return;
+
+  bool gradient = r1 > 0 && r1 < height;
+  for (int k=0;k<axisTicks;k++) {
+    int r = axisRow[k];
+    if (r1 >= 0 && r >= r0 && r < r1) continue;
+    if (r1 >= 0 && r >= r1 && gradient && gradientIndex(r, multi) != 0) continue;
+    chartVSpan(x, r, r + 1, chartColor(2));
+  }
+}
+
+/***************************************************************************************
+** Function name:           drawBandColumn
+** Description:             Fills column x between the Bollinger band lines where it shows
+**                          black, above the line and past the end of the gradient, so the
+**                          line and gradient show through the band
+***************************************************************************************/
+void KGFX::drawBandColumn(int x, int r0, int r1, int height, int multi, int *seg) {
+  if (chartBand < 0 || chartBandFill < 0) return;
+
+  const int one = 256;
+  int32_t top, bot, lowTop, lowBot;
+  int s = overlayStart[chartBand], m = overlayStart[chartBand+1] - s;
+  if (!lineColumn(overlayX.data() + s, overlayY.data() + s, m, x, seg[0], top, bot)) return;
+  s = overlayStart[chartBand+1], m = overlayStart[chartBand+2] - s;
+  if (!lineColumn(overlayX.data() + s, overlayY.data() + s, m, x, seg[1], lowTop, lowBot)) return;
+
+  int b0 = (std::min(top, lowTop) + one/2) >> 8;
+  int b1 = (std::max(bot, lowBot) + K_CHART_LINE * one + one/2) >> 8;
+  uint32_t c = chartColor(15 - overlays);
+  if (r1 < 0) {
+    chartVSpan(x, b0, b1, c);
+    return;
+  }
+
+  // Rows under the line stay gradient until its last band
+  int black = r1 > 0 && r1 < height ? std::max(r1, 14*multi + 1) : r1;
+  chartVSpan(x, b0, std::min(b1, r0), c);
+  chartVSpan(x, std::max(b0, black), b1, c);
+}
+
+/***************************************************************************************
+** Function name:           addIndicators
+** Description:             Maps the enabled indicators of series as overlays at the points
+**                          picked for its samples, in the range set by fmtChartArray
+***************************************************************************************/
+void KGFX::addIndicators(const KGFXSeries &series, int spacing) {
+  if (chartX.empty()) return;
+
+  for (int kind=0;kind<K_INDICATORS;kind++) {
+    if (series.ind[kind].empty()) continue;
+    if (kind == K_BAND_UPPER && series.bandFillColor >= 0) {
+      chartBand = overlays;
+      chartBandFill = series.bandFillColor;
+    }
+    overlayStart[overlays] = overlayX.size();
+    overlayColor[overlays] = series.indColor[kind];
+    mapChartPoints(series.ringSpan(series.ind[kind]), chartIdx.data(), chartIdx.size(), spacing,
+                   overlayX, overlayY, 0, chartScale == K_SCALE_LOG);
+    overlays++;
+  }
+  overlayStart[overlays] = overlayX.size();
+}
+
+/***************************************************************************************
+** Function name:           drawLabelColumn
+** Description:             Draws column x of the cached tick labels over the chart
+***************************************************************************************/
+void KGFX::drawLabelColumn(int x) {
+  if (x < axisLeft) return;
+
+  for (int k=0;k<axisTicks;k++) {
+    const AxisLabel &l = axisLabels[k];
+    int lx = x - axisLabelX[k];
+    if (lx < 0 || lx >= l.width) continue;
+    for (int i=l.colStart[lx];i<l.colStart[lx+1];i+=2) {
+      chartVSpan(x, axisLabelY[k] + l.spans[i], axisLabelY[k] + l.spans[i+1], chartColor(1));
+    }
+  }
+}
+
+/***************************************************************************************
+** Function name:           updateChartAxis
+** Description:             Picks ticks at a 1, 2 or 5 times power of ten interval over the
+**                          chart range, at most chartAxisTicks, and places their gridlines
+**                          and right aligned labels. Labels are only rendered for tick
+**                          values that were not already showing, and the ticks are kept
+**                          while the range and layout stay the same. Percent charts label
+**                          the change from the base sample, log charts values or powers of
+**                          ten. A range that is not finite has no ticks
+***************************************************************************************/
+void KGFX::updateChartAxis() {
+  int w = chartTarget->width();
+  int h = chartViewHeight();
+
+  axisTicks = 0;
+  axisLeft = w;
+  if (chartAxisTicks <= 0 || chartRows <= 0) return;
+
+  if (chartLo == axisKeyLo && chartHi == axisKeyHi && chartRows == axisKeyRows
+      && chartScale == axisKeyScale && (chartScale != K_SCALE_PERCENT || chartBase == axisKeyBase)
+      && chartAxisTicks == axisKeyTicks && w == axisKeyWidth && h == axisKeyHeight) {
+    axisTicks = axisLabels.size();
+    for (int k=0;k<axisTicks;k++) {
+      axisLeft = std::min(axisLeft, (int)axisLabelX[k]);
+    }
+    return;
+  }
+
+  // Ticks are picked in the labelled domain: values, percent from the base sample,
+  // or on a log scale values within a decade and whole powers of ten beyond it
+  float lo = chartLo, hi = chartHi;
+  bool decades = false;
+  if (chartScale == K_SCALE_LOG) {
+    decades = chartHi - chartLo >= 1;
+    if (!decades) {
+      lo = powf(10, chartLo);
+      hi = powf(10, chartHi);
+    }
+  } else if (chartScale == K_SCALE_PERCENT && chartBase != 0) {
+    lo = (chartLo / chartBase - 1) * 100;
+    hi = (chartHi / chartBase - 1) * 100;
+    if (lo > hi) std::swap(lo, hi);
+  }
+  if (!isfinite(lo) || !isfinite(hi) || !isfinite(hi - lo)) return;
+
+  float step = 0;
+  float first = 1; // in steps
+  int count = 1;
+  int decimals = 0;
+  if (hi > lo) {
+    float raw = (hi - lo) / chartAxisTicks;
+    float mag = powf(10, floorf(log10f(raw)));
+    float r = raw / mag;
+    step = (r <= 1 ? 1 : r <= 2 ? 2 : r <= 5 ? 5 : 10) * mag;
+    if (decades) step = std::max(1.0f, ceilf(raw));
+    first = ceilf(lo / step);
+    count = (int)floorf((hi / step - first) + 1e-3f) + 1;
+    if (step < 1) {
+      decimals = std::min(6, (int)ceilf(-log10f(step) - 1e-3f));
+    }
+  }
+  count = std::max(0, std::min(count, K_MAX_TICKS));
+
+  std::vector<AxisLabel> labels(count);
+  for (int k=0;k<count;k++) {
+    float d = step > 0 ? (first + k) * step : lo;
+    if (d == 0) d = 0; // no "-0" label
+    AxisLabel &l = labels[k];
+
+    // v is the tick in the range chartRow maps
+    float v = d;
+    if (decades) {
+      snprintf(l.text, sizeof(l.text), "%.*f", d < 0 ? std::min(6, (int)-d) : 0, powf(10, d));
+    } else if (chartScale == K_SCALE_LOG) {
+      v = log10f(d);
+      snprintf(l.text, sizeof(l.text), "%.*f", decimals, d);
+    } else if (chartScale == K_SCALE_PERCENT && chartBase != 0) {
+      v = chartBase * (1 + d / 100);
+      snprintf(l.text, sizeof(l.text), "%.*f%%", decimals, d);
+    } else {
+      snprintf(l.text, sizeof(l.text), "%.*f", decimals, d);
+    }
+
+    // Reuse the bitmap when the value was already labelled
+    bool cached = false;
+    for (AxisLabel &old : axisLabels) {
+      if (strcmp(old.text, l.text) == 0) {
+        l = std::move(old);
+        old.text[0] = 0;
+        cached = true;
+        break;
+      }
+    }
+    if (!cached) renderAxisLabel(l);
+
+    // Gridlines run through the middle of the line thickness
+    int row = (chartRow(v) + K_CHART_LINE * 128 + 128) >> 8;
+    axisRow[k] = row;
+    axisLabelX[k] = w - 1 - l.width;
+    axisLabelY[k] = std::max(0, std::min(row - l.height/2, h - l.height));
+    axisLeft = std::min(axisLeft, (int)axisLabelX[k]);
+  }
+  axisLabels = std::move(labels);
+  axisTicks = count;
+
+  axisKeyLo = chartLo;
+  axisKeyHi = chartHi;
+  axisKeyBase = chartBase;
+  axisKeyRows = chartRows;
+  axisKeyScale = chartScale;
+  axisKeyTicks = chartAxisTicks;
+  axisKeyWidth = w;
+  axisKeyHeight = h;
+}
+
+/***************************************************************************************
+** Function name:           renderAxisLabel
+** Description:             Renders the label text in the smallest Arial to a scratch sprite
+**                          and keeps its ink as vertical spans. The font, colors, bold and
+**                          cursor of the caller are put back
+***************************************************************************************/
+void KGFX::renderAxisLabel(AxisLabel &label) {
+  const tftfont_t *font = tft.TTFfont();
+  uint32_t color = tft.TTFtextColor();
+  uint32_t bgColor = tft.TTFtextBgColor();
+  uint8_t embolden = tft.TTFembolden();
+  int cursorX = tft.getCursorX();
+  int cursorY = tft.getCursorY();
+
+  const tftfont_t &f = *arialLadder[0];
+  TTFmetrics_t m;
+  tft.setTTFFont(f);
+  tft.setTTFEmbolden(0);
+  tft.TTFmeasureText(label.text, &m);
+
+  int w = m.x1 > 0 ? m.x1 : 1;
+  int h = m.y1 > m.y0 ? m.y1 - m.y0 : 1;
+  label.width = w;
+  label.height = h;
+  label.colStart.assign(w + 1, 0);
+  label.spans.clear();
+  axisLabelRenders++;
+
+  TFT_eSprite spr = TFT_eSprite(&tft);
+  spr.setColorDepth(8);
+  uint8_t *buf = (uint8_t *)spr.createSprite(w, h);
+  if (buf) {
+    tft.TTFdestination(&spr);
+    spr.fillSprite(TFT_BLACK);
+    tft.setTextColor(TFT_WHITE, TFT_BLACK);
+    tft.setCursor(0, -m.y0);
+    tft.print(label.text);
+    tft.TTFdestination(chartTarget);
+  }
+
+  if (font) tft.setTTFFont(*font);
+  else tft.clearTTFont();
+  tft.setTextColor(color, bgColor);
+  tft.setTTFEmbolden(embolden);
+  tft.setCursor(cursorX, cursorY);
+  if (!buf) return;
+
+  for (int x=0;x<w;x++) {
+    label.colStart[x] = label.spans.size();
+    for (int y=0;y<h;y++) {
+      if (!buf[y * w + x]) continue;
+      int y0 = y;
+      while (y < h && buf[y * w + x]) y++;
+      label.spans.push_back(y0);
+      label.spans.push_back(y);
+    }
+  }
+  label.colStart[w] = label.spans.size();
+
+  spr.deleteSprite();
+}
+
+/***************************************************************************************
+** Function name:           drawOverlayColumn
+** Description:             Draws column x of the overlay series over the primary line and
+**                          gradient. Overlay lines are K_CHART_LINE rows without gradient or
+**                          edge blending, edge rows are drawn when at least half covered
+***************************************************************************************/
+void KGFX::drawOverlayColumn(int x, int *seg) {
+  const int one = 256;
+  for (int k=0;k<overlays;k++) {
+    int s = overlayStart[k];
+    int32_t top, bot;
+    if (!lineColumn(overlayX.data() + s, overlayY.data() + s, overlayStart[k+1] - s, x, seg[k], top, bot)) {
+      continue;
+    }
+    bot += K_CHART_LINE * one;
+    int r0 = (top + one/2) >> 8;
+    int r1 = (bot + one/2) >> 8;
+    chartVSpan(x, r0, r1, chartColor(15 - k));
+  }
+}
+
+/***************************************************************************************
+** Function name:           lineColumn
+** Description:             Finds the rows, in 1/256 pixel fixed point, the polyline xs/ys of n
+**                          points covers from x - 0.5 to x + 0.5, without line thickness.
+**                          seg carries the segment search across calls with increasing x.
+**                          Returns false where the polyline does not reach column x
+***************************************************************************************/
+bool KGFX::lineColumn(const int16_t *xs, const int32_t *ys, int n, int x, int &seg, int32_t &top, int32_t &bot) {
+  if (n < 2 || x < xs[0] || x > xs[n-1]) return false;
+
+  // Fixed point row of segment i at x2/2, x2 in half pixels. Segments with a missing
+  // end are not drawn
+  top = INT32_MAX;
+  bot = INT32_MIN;
+  auto addSegment = [&](int i, int x2) {
+    int xa = xs[i], xb = xs[i+1];
+    int ya = ys[i], yb = ys[i+1];
+    if (ya == K_ROW_MISSING || yb == K_ROW_MISSING) return;
+    int32_t y = ya + (yb - ya) * (x2 - 2*xa) / (2 * (xb - xa));
+    top = std::min(top, y);
+    bot = std::max(bot, y);
+  };
+
+  while (seg < n-2 && xs[seg+1] < x) seg++;
+  if (x > xs[0]) {
+    addSegment(seg, 2*x - 1);
+  }
+  int k = seg;
+  for (int i=seg;i<n && xs[i]<=x;i++) {
+    if (xs[i] == x && ys[i] != K_ROW_MISSING) {
+      top = std::min(top, ys[i]);
+      bot = std::max(bot, ys[i]);
+    }
+    k = i;
+  }
+  if (x < xs[n-1]) {
+    addSegment(k, 2*x + 1);
+  }
+  return top <= bot;
+}
+
+/***************************************************************************************
+** Function name:           chartViewHeight
+** Description:             Height in rows of the chart being rasterized, the target sprite
+**                          height unless it is drawn in bands
+***************************************************************************************/
+int KGFX::chartViewHeight() {
+  return chartViewRows > 0 ? chartViewRows : chartTarget->height();
+}
+
+/***************************************************************************************
+** Function name:           chartVSpan
+** Description:             Writes chart rows y0 to y1 (exclusive) of column x of the target
+**                          sprite buffer with c, a chartColor() value. Rows are clipped to
+**                          chartClipTop..chartClipBottom, shifted by chartTargetTop and
+**                          clipped to the target
+***************************************************************************************/
+void KGFX::chartVSpan(int x, int y0, int y1, uint32_t c) {
+  uint8_t *buf = (uint8_t *)chartTarget->getPointer();
+  int w = chartTarget->width();
+  y0 = std::max(y0, chartClipTop);
+  y1 = std::min(y1, chartClipBottom);
+  y0 -= chartTargetTop;
+  y1 -= chartTargetTop;
+  if (y0 < 0) y0 = 0;
+  if (y1 > chartTarget->height()) y1 = chartTarget->height();
+  if (!buf || x < 0 || x >= w || y0 >= y1) return;
+
+  // Only pixels that change mark the column dirty, so redrawing what is there
+  // pushes nothing
+  uint16_t v = chartNative(c);
+  bool changed = false;
+  switch (chartTarget->getColorDepth()) {
+    case 16: {
+      uint16_t *p = (uint16_t *)buf + y0 * w + x;
+      for (int y=y0;y<y1;y++, p+=w) {
+        if (*p != v) { *p = v; changed = true; }
+      }
+      break;
+    }
+    case 8: {
+      uint8_t *p = buf + y0 * w + x;
+      for (int y=y0;y<y1;y++, p+=w) {
+        if (*p != v) { *p = v; changed = true; }
+      }
+      break;
+    }
+    case 4: {
+      int stride = ((w + 1) & ~1) >> 1;
+      uint8_t *p = buf + y0 * stride + (x >> 1);
+      uint8_t mask = (x & 1) ? 0xF0 : 0x0F;
+      if (!(x & 1)) v <<= 4;
+      for (int y=y0;y<y1;y++, p+=stride) {
+        uint8_t b = (*p & mask) | v;
+        if (*p != b) { *p = b; changed = true; }
+      }
+      break;
+    }
+    default:
+      chartTarget->drawFastVLine(x, y0, y1 - y0, c);
+      changed = true;
+  }
+  if (changed) markChartDirty(x, x + 1);
+}
+
+/***************************************************************************************
+** Function name:           chartVCopy
+** Description:             Copies chart rows y0 to y1 (exclusive) of col, a column in sprite
+**                          buffer format indexed by chart row, into column x of the target
+**                          sprite buffer
+***************************************************************************************/
+void KGFX::chartVCopy(int x, int y0, int y1, const uint16_t *col) {
+  uint8_t *buf = (uint8_t *)chartTarget->getPointer();
+  int w = chartTarget->width();
+  y0 = std::max(y0, chartClipTop);
+  y1 = std::min(y1, chartClipBottom);
+  col += chartTargetTop;
+  y0 -= chartTargetTop;
+  y1 -= chartTargetTop;
+  if (y0 < 0) y0 = 0;
+  if (y1 > chartTarget->height()) y1 = chartTarget->height();
+  if (!buf || x < 0 || x >= w || y0 >= y1) return;
+
+  bool changed = false;
+  switch (chartTarget->getColorDepth()) {
+    case 16: {
+      uint16_t *p = (uint16_t *)buf + y0 * w + x;
+      for (int y=y0;y<y1;y++, p+=w) {
+        if (*p != col[y]) { *p = col[y]; changed = true; }
+      }
+      break;
+    }
+    case 8: {
+      uint8_t *p = buf + y0 * w + x;
+      for (int y=y0;y<y1;y++, p+=w) {
+        if (*p != col[y]) { *p = col[y]; changed = true; }
+      }
+      break;
+    }
+    case 4: {
+      int stride = ((w + 1) & ~1) >> 1;
+      uint8_t *p = buf + y0 * stride + (x >> 1);
+      uint8_t mask = (x & 1) ? 0xF0 : 0x0F;
+      int shift = (x & 1) ? 0 : 4;
+      for (int y=y0;y<y1;y++, p+=stride) {
+        uint8_t b = (*p & mask) | (col[y] << shift);
+        if (*p != b) { *p = b; changed = true; }
+      }
+      break;
+    }
+    default:
+      for (int y=y0;y<y1;y++) chartTarget->drawPixel(x, y, col[y]);
+      changed = true;
+  }
+  if (changed) markChartDirty(x, x + 1);
+}
+
+/***************************************************************************************
+** Function name:           chartNative
+** Description:             Converts a chartColor() value to the chart sprite buffer format,
+**                          byte swapped RGB565, RGB332 or a palette index
+***************************************************************************************/
+uint16_t KGFX::chartNative(uint32_t c) {
+  switch (chartTarget->getColorDepth()) {
+    case 16: return (uint16_t)((c >> 8) | (c << 8));
+    case 8:  return (uint8_t)((c & 0xE000)>>8 | (c & 0x0700)>>6 | (c & 0x0018)>>3);
+    case 4:  return c & 0x0F;
+    default: return c;
+  }
+}
+
+/***************************************************************************************
+** Function name:           gradientColumn
+** Description:             Returns the gradient template for the band height multi, the
+**                          gradient is anchored to sprite rows so every column copies its
+**                          rows below the line from the same template
+***************************************************************************************/
+const uint16_t *KGFX::gradientColumn(int multi) {
+  int h = chartViewHeight();
+  int bpp = chartTarget->getColorDepth();
+
+  if (multi == gradMulti && bpp == gradDepth && (int)gradColumn.size() == h
+      && gradMaxIndex == gradMax && memcmp(gradPalette, palette, sizeof(palette)) == 0) {
+    return gradColumn.data();
+  }
+
+  gradColumn.resize(h);
+  for (int r=0;r<h;r++) {
+    gradColumn[r] = chartNative(chartColor(gradientIndex(r, multi)));
+  }
+  memcpy(gradPalette, palette, sizeof(palette));
+  gradMulti = multi;
+  gradDepth = bpp;
+  gradMax = gradMaxIndex;
+
+  return gradColumn.data();
+}
+
+/***************************************************************************************
+** Function name:           gradientIndex
+** Description:             Palette entry of the chart gradient at the given row, 0 past its
+**                          end. Bands of multi rows step through entries 3 to 15, charts
+**                          with bands over 5 rows use entry 8 throughout. Entries past
+**                          gradMaxIndex hold overlay line colors and are not used
+***************************************************************************************/
+int KGFX::gradientIndex(int row, int multi) {
+  if (row >= 14*multi + 1) return 0;
+  if (multi > 5) return std::min(8, gradMaxIndex);
+  if (row <= multi) return 3;
+  return std::min(3 + (row - multi - 1)/multi, gradMaxIndex);
+}
+
+/***************************************************************************************
+** Function name:           createBlendTable
+** Description:             Blends the line color over every palette entry per coverage level.
+**                          4 bit sprites cannot hold blends, coverage is rounded to the line,
+**                          to palette entry 2 (half line over black, unused by the gradient)
+**                          or to the entry underneath
+***************************************************************************************/
+void KGFX::createBlendTable() {
+  bool indexed = chartTarget->getColorDepth() == 4;
+  uint16_t fg = palette[1];
+
+  for (int q=0;q<=K_CHART_AA_LEVELS;q++) {
+    for (int i=0;i<16;i++) {
+      if (indexed) {
+        if (q*4 >= K_CHART_AA_LEVELS*3) chartBlend[q][i] = 1;
+        else if (q*4 >= K_CHART_AA_LEVELS) chartBlend[q][i] = 2;
+        else chartBlend[q][i] = i;
+        continue;
+      }
+      uint16_t bg = palette[i];
+      int r = (((fg >> 11) & 0x1F) * q + ((bg >> 11) & 0x1F) * (K_CHART_AA_LEVELS - q)) / K_CHART_AA_LEVELS;
+      int g = (((fg >> 5) & 0x3F) * q + ((bg >> 5) & 0x3F) * (K_CHART_AA_LEVELS - q)) / K_CHART_AA_LEVELS;
+      int b = ((fg & 0x1F) * q + (bg & 0x1F) * (K_CHART_AA_LEVELS - q)) / K_CHART_AA_LEVELS;
+      chartBlend[q][i] = (r << 11) | (g << 5) | b;
+    }
+  }
+}
+
+/***************************************************************************************
+** Function name:           scrollChart
+** Description:             Shifts the chart sprite content and line bottoms dx pixels left,
+**                          the exposed columns are cleared to black
+***************************************************************************************/
+void KGFX::scrollChart(int dx) {
+  uint8_t *buf = (uint8_t *)chartSpr.getPointer();
+  int w = chartSpr.width();
+  int h = chartSpr.height();
+  int bpp = chartSpr.getColorDepth();
+  if (!buf || dx <= 0) return;
+
+  // Every column takes the content of another
+  std::fill(chartDirty.begin(), chartDirty.end(), true);
+
+  if (dx >= w) {
+    chartSpr.fillSprite(TFT_BLACK);
+    chartBottom.assign(w, -1);
+    return;
+  }
+
+  chartBottom.erase(chartBottom.begin(), chartBottom.begin() + dx);
+  chartBottom.resize(w, -1);
+
+  // Black is 0 at every color depth and palette index 0 in 4 bit sprites
+  if (bpp == 16 || bpp == 8) {
+    int bytes = bpp / 8;
+    for (int j=0;j<h;j++) {
+      uint8_t *row = buf + j * w * bytes;
+      memmove(row, row + dx * bytes, (w - dx) * bytes);
+      memset(row + (w - dx) * bytes, 0, dx * bytes);
+    }
+  } else if (bpp == 4) {
+    int stride = ((w + 1) & ~1) >> 1;
+    for (int j=0;j<h;j++) {
+      uint8_t *row = buf + j * stride;
+      if ((dx & 1) == 0) {
+        memmove(row, row + (dx >> 1), stride - (dx >> 1));
+      } else {
+        for (int i=0;i<stride;i++) {
+          int k = i + (dx >> 1);
+          uint8_t lo = k + 1 < stride ? row[k + 1] >> 4 : 0;
+          row[i] = k < stride ? (uint8_t)(row[k] << 4) | lo : 0;
+        }
+      }
+      for (int x=w-dx;x<w;x++) {
+        row[x >> 1] &= (x & 1) ? 0xF0 : 0x0F;
+      }
+    }
+  } else {
+    chartSpr.scroll(-dx);
+  }
+}
+
+/***************************************************************************************
+** Function name:           drawChartWide
+** Description:             Draws default chart size that fills entire width to sprite
+***************************************************************************************/
+void KGFX::drawChartWide(const std::vector<float> &arr, int color, int y) {
+  drawChart(arr, color, y, 8);
+}
+
+/***************************************************************************************
+** Function name:           drawChartLarge
+** Description:             Draws wide chart that default to 120 pixel height chart
+***************************************************************************************/
+void KGFX::drawChartLarge(const std::vector<float> &arr, int color, int y, int height) {
+  drawChart(arr, color, y, 8, height);
+}
+
+/***************************************************************************************
+** Function name:           createPalette
+** Description:             Fills the chart palette, 0 is the background, 1 the line
+**                          color and 2-15 the gradient shades
+***************************************************************************************/
+void KGFX::createPalette(int color) {
+  const uint16_t *shades;
+  if (color == K_GREEN) {
+    shades = green_palette + 1;
+  } else if (color == K_RED) {
+    shades = red_palette + 1;
+  } else {
+    shades = shadeRamp(color);
+  }
+
+  palette[1] = color;
+  for (int i=0;i<K_SHADES;i++) {
+    palette[i+2] = shades[i];
+  }
+
+  // Entry 2 is not used by the gradient, it holds the half covered line edge for 4 bit sprites
+  palette[2] = ((color >> 1) & 0x7BEF);
+}
+
+/***************************************************************************************
+** Function name:           shadeRamp
+** Description:             Returns the gradient shades generated for color, computed with
+**                          kgfxShade on first use and cached
+***************************************************************************************/
+const uint16_t *KGFX::shadeRamp(int color) {
+  for (int i=0;i<K_SHADE_CACHE;i++) {
+    if (shadeCacheColor[i] == color) {
+      return shadeCache[i];
+    }
+  }
+
+  int slot = shadeCacheNext;
+  shadeCacheNext = (shadeCacheNext + 1) % K_SHADE_CACHE;
+  for (int i=0;i<K_SHADES;i++) {
+    shadeCache[slot][i] = kgfxShade(color, i);
+  }
+  shadeCacheColor[slot] = color;
+  return shadeCache[slot];
+}
+
+/***************************************************************************************
+** Function name:           chartColor
+** Description:             Color to draw palette entry idx with on the chart sprite,
+**                          4 bit sprites take the palette index itself
+***************************************************************************************/
+uint32_t KGFX::chartColor(int idx) {
+  if (chartTarget->getColorDepth() == 4) {
+    return idx;
+  }
+  return palette[idx];
+}
+
+/***************************************************************************************
+** Function name:           setChartRange
+** Description:             Sets the value range chartRow maps to rows 0 (hi) to rows (lo)
+***************************************************************************************/
+void KGFX::setChartRange(float lo, float hi, int rows) {
+  chartLo = lo;
+  chartHi = hi;
+  chartRows = rows;
+  chartRowScale = hi - lo > 0 ? rows * 256.0f / (hi - lo) : 0;
+}
+
+/***************************************************************************************
+** Function name:           fitChartRange
+** Description:             Sets the range of line `line` of the chart at screen row y to the
+**                          data range lo..hi, or to its auto-range. The range each line was
+**                          last drawn with is kept, slots reused round robin. Returns true
+**                          when the range or rows differ from that one
+***************************************************************************************/
+bool KGFX::fitChartRange(int y, int line, float lo, float hi, int rows) {
+  ChartRange *r = nullptr;
+  for (int i=0;i<K_CHART_RANGES;i++) {
+    if (chartRanges[i].y == y && chartRanges[i].line == line) {
+      r = &chartRanges[i];
+    }
+  }
+  if (!r) {
+    r = &chartRanges[chartRangeNext];
+    chartRangeNext = (chartRangeNext + 1) % K_CHART_RANGES;
+    *r = ChartRange();
+    r->y = y;
+    r->line = line;
+  }
+
+  // A range on another scale is in other units
+  bool known = r->scale == chartScale;
+  bool held = autoRange && lo <= hi;
+  if (held) {
+    fitAutoRange(known && r->held ? r : nullptr, lo, hi);
+  }
+
+  bool changed = !known || lo != r->lo || hi != r->hi || rows != r->rows;
+  r->scale = chartScale;
+  r->held = held;
+  r->lo = lo;
+  r->hi = hi;
+  r->rows = rows;
+  setChartRange(lo, hi, rows);
+  return changed;
+}
+
+/***************************************************************************************
+** Function name:           fitAutoRange
+** Description:             Replaces the data range lo..hi with the held auto-range while it
+**                          still fits, otherwise pads it by autoHeadroom of the data span on
+**                          each side. Flat data is padded by its magnitude
+***************************************************************************************/
+void KGFX::fitAutoRange(const ChartRange *held, float &lo, float &hi) {
+  float span = hi - lo;
+  if (span <= 0) span = fabsf(hi) > 0 ? fabsf(hi) : 1;
+  float need = span * (1 + 2*autoHeadroom);
+
+  if (held && lo >= held->lo && hi <= held->hi && held->hi - held->lo <= need * (1 + autoHysteresis)) {
+    lo = held->lo;
+    hi = held->hi;
+    return;
+  }
+
+  lo -= span * autoHeadroom;
+  hi += span * autoHeadroom;
+}
+
+/***************************************************************************************
+** Function name:           chartLineRows
+** Description:             Rows the line of a chart of the given height ranges over, the
+**                          rest is left for the line thickness and the gradient below
+***************************************************************************************/
+int KGFX::chartLineRows(int height) {
+  return height > 80 ? (height/5)*4 : 50;
+}
+
+/***************************************************************************************
+** Function name:           chartRow
+** Description:             Maps a value to a row in 1/256 pixel fixed point. Only the distance
+**                          to hi is scaled so magnitude does not matter, from sub-cent prices
+**                          to millions. A flat range maps to the middle and values outside
+**                          the range are clamped. NaN and infinities are missing samples,
+**                          K_ROW_MISSING, which line charts leave as a gap
+***************************************************************************************/
+int32_t KGFX::chartRow(float v) {
+  if (!isfinite(v)) return K_ROW_MISSING;
+  if (chartRowScale <= 0) return chartRows * 128;
+  if (!(v >= chartLo)) v = chartLo;
+  if (v > chartHi) v = chartHi;
+  return (int32_t)((chartHi - v) * chartRowScale + 0.5f);
+}
+
+/***************************************************************************************
+** Function name:           fmtChartArray
+** Description:             Maps a series of any length to chart points. Series that fit
+**                          at the given spacing are plotted as is, longer ones are spread
+**                          over the sprite width and decimated to the min and max sample
+**                          of every two pixel column bucket so spikes stay visible. The
+**                          range also covers coverLo..coverHi, for series drawn over it.
+**                          Returns the number of points in chartX/chartY
+***************************************************************************************/
+int KGFX::fmtChartArray(const KGFXSpan &arr, int y, int spacing, int height, float coverLo, float coverHi) {
+  int n = arr.size();
+  int width = chartTarget->width();
+
+  chartIdx.clear();
+  chartX.clear();
+  chartY.clear();
+  chartSamples = 0;
+  overlays = 0;
+  overlayX.clear();
+  overlayY.clear();
+  chartBand = -1;
+  chartBandFill = -1;
+  if (n < 2 || width < 2) {
+    Serial.println("Malformed array len: cannot fmt");
+    return 0;
+  }
+
+  float lo, hi;
+  bool logs = chartScale == K_SCALE_LOG && !arr.logged;
+  decimateChart(arr, chartIdx);
+  chartValueRange(arr, chartIdx.data(), chartIdx.size(), logs, lo, hi);
+  lo = std::min(lo, coverLo);
+  hi = std::max(hi, coverHi);
+  if (chartScale == K_SCALE_PERCENT) {
+    chartBase = NAN;
+    for (int i=0;i<n && !(chartBase == chartBase);i++) chartBase = arr[i];
+  }
+
+  chartSamples = n;
+  chartSpaced = spacing > 0 && (n-1)*spacing < width;
+  chartRescaled = fitChartRange(y, 0, lo, hi, chartLineRows(height));
+  mapChartPoints(arr, chartIdx.data(), chartIdx.size(), spacing, chartX, chartY, 0, logs);
+
+  return chartX.size();
+}
+
+/***************************************************************************************
+** Function name:           decimateChart
+** Description:             Appends the indices of the samples of arr to plot to idx. Series up
+**                          to the sprite width are kept whole, longer ones keep the min and
+**                          max sample of every two pixel column bucket, in time order, so
+**                          spikes stay visible. width 0 is the sprite width, widths under
+**                          2 are taken as 2
+***************************************************************************************/
+void KGFX::decimateChart(const KGFXSpan &arr, std::vector<int32_t> &idx, int width) {
+  int n = arr.size();
+  if (width <= 0) width = chartTarget->width();
+  width = std::max(width, 2);
+
+  if (n <= width) {
+    for (int i=0;i<n;i++) {
+      idx.push_back(i);
+    }
+    return;
+  }
+
+  const KGFXSpan &v = arr;
+  int buckets = width/2;
+  for (int b=0;b<buckets;b++) {
+    int s = (long)b*n/buckets;
+    int e = (long)(b+1)*n/buckets;
+    int imin = s, imax = s;
+    float vmin = INFINITY, vmax = -INFINITY; // a missing first sample must not hide the range
+    for (int i=s;i<e;i++) {
+      if (!isfinite(v[i])) continue;
+      if (v[i] < vmin) { vmin = v[i]; imin = i; }
+      if (v[i] > vmax) { vmax = v[i]; imax = i; }
+    }
+    if (b == 0 && imin != 0 && imax != 0) idx.push_back(0);
+    idx.push_back(imin < imax ? imin : imax);
+    if (imin != imax) idx.push_back(imin < imax ? imax : imin);
+  }
+  if (idx.back() != n-1) idx.push_back(n-1);
+}
+
+/***************************************************************************************
+** Function name:           chartMinMax
+** Description:             Min and max of the picked samples in one pass, straight over the
+**                          samples when none were dropped, or the range the source keeps.
+**                          NaN and infinite samples are missing and left out
+***************************************************************************************/
+void KGFX::chartMinMax(const KGFXSpan &arr, const int32_t *idx, int m, float &lo, float &hi) {
+  int n = arr.size();
+
+  lo = INFINITY;
+  hi = -INFINITY;
+  if (arr.ranged) {
+    // Decimation keeps the min and max of every bucket so the range is unchanged
+    lo = arr.lo;
+    hi = arr.hi;
+  } else if (m == n) {
+    const float *parts[2] = {arr.a, arr.b};
+    int lens[2] = {arr.na, arr.nb};
+    for (int p=0;p<2;p++) {
+      const float *v = parts[p];
+      for (int i=0;i<lens[p];i++) {
+        if (!isfinite(v[i])) continue;
+        lo = v[i] < lo ? v[i] : lo;
+        hi = v[i] > hi ? v[i] : hi;
+      }
+    }
+  } else {
+    for (int i=0;i<m;i++) {
+      float v = arr[idx[i]];
+      if (!isfinite(v)) continue;
+      lo = v < lo ? v : lo;
+      hi = v > hi ? v : hi;
+    }
+  }
+}
+
+/***************************************************************************************
+** Function name:           chartValueRange
+** Description:             Range of the picked samples as charted, the logs of the positive
+**                          ones when logs is set
+***************************************************************************************/
+void KGFX::chartValueRange(const KGFXSpan &arr, const int32_t *idx, int m, bool logs, float &lo, float &hi) {
+  chartMinMax(arr, idx, m, lo, hi);
+  if (!logs) return;
+  if (lo > 0) {
+    lo = log10f(lo);
+    hi = log10f(hi);
+    return;
+  }
+
+  // Only positive samples have a log, the range comes from the picks that do
+  lo = INFINITY;
+  hi = -INFINITY;
+  for (int i=0;i<m;i++) {
+    float v = arr[idx[i]];
+    if (!(v > 0)) continue;
+    v = log10f(v);
+    lo = std::min(lo, v);
+    hi = std::max(hi, v);
+  }
+}
+
+/***************************************************************************************
+** Function name:           mapChartPoints
+** Description:             Appends the picked samples as chart points, rows in the range set
+**                          by setChartRange, as logs when logs is set. Series that fit at
+**                          spacing keep it, others and spacing 0 are spread over width, 0
+**                          being the sprite width
+***************************************************************************************/
+void KGFX::mapChartPoints(const KGFXSpan &arr, const int32_t *idx, int m, int spacing,
+                          std::vector<int16_t> &xs, std::vector<int32_t> &ys, int width, bool logs) {
+  int n = arr.size();
+  if (width <= 0) width = chartTarget->width();
+  bool spaced = spacing > 0 && (n-1)*spacing < width;
+
+  for (int i=0;i<m;i++) {
+    int k = idx[i];
+    float v = arr[k];
+    if (logs) v = v > 0 ? log10f(v) : NAN;
+    xs.push_back(spaced ? k*spacing : (long)k*(width-1)/(n-1));
+    ys.push_back(chartRow(v));
+  }
+}
+
+/***************************************************************************************
+** Function name:           kgfxSin
+** Description:             Sine of a binary angle, 65536 per turn, in Q14 from the quarter
+**                          wave table with the low 8 bits interpolated
+***************************************************************************************/
+static int32_t kgfxSin(uint16_t a) {
+  uint16_t q = a >> 14;
+  uint16_t r = a & 0x3FFF;
+  if (q & 1) r = 0x4000 - r;
+
+  int i = r >> 8;
+  int32_t v = sinTable[64];
+  if (i < 64) v = sinTable[i] + (((sinTable[i+1] - sinTable[i]) * (r & 0xFF)) >> 8);
+  return (q & 2) ? -v : v;
+}
+
+/***************************************************************************************
+** Function name:           kgfxAtan
+** Description:             Binary angle of atan(n/d) for 0 <= n <= d, d > 0
+***************************************************************************************/
+static uint32_t kgfxAtan(uint32_t n, uint32_t d) {
+  uint32_t t = (uint32_t)(((uint64_t)n << 14) / d);
+  int i = t >> 8;
+  if (i >= 64) return atanTable[64];
+  return atanTable[i] + (((atanTable[i+1] - atanTable[i]) * (t & 0xFF)) >> 8);
+}
+
+/***************************************************************************************
+** Function name:           kgfxAngle
+** Description:             Binary angle of the screen offset dx, dy, 0 at 12 o'clock and
+**                          growing clockwise
+***************************************************************************************/
+static uint16_t kgfxAngle(int32_t dx, int32_t dy) {
+  uint32_t ax = dx < 0 ? -dx : dx;
+  uint32_t ay = dy < 0 ? -dy : dy;
+  if (!ax && !ay) return 0;
+
+  // Angle from the vertical axis, 0 to 16384
+  uint32_t a = ax <= ay ? kgfxAtan(ax, ay) : 16384 - kgfxAtan(ay, ax);
+  if (dy <= 0) return dx >= 0 ? a : 65536 - a;
+  return dx >= 0 ? 32768 - a : 32768 + a;
+}
+
+/***************************************************************************************
+** Function name:           kgfxSqrt
+** Description:             Integer square root, rounded down
+***************************************************************************************/
+static int32_t kgfxSqrt(int32_t v) {
+  if (v <= 0) return 0;
+  uint32_t r = 0;
+  uint32_t bit = 1UL << 30;
+  uint32_t n = v;
+  while (bit > n) bit >>= 2;
+  while (bit) {
+    if (n >= r + bit) {
+      n -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return r;
+}
+
+/***************************************************************************************
+** Function name:           drawRing
+** Description:             Fills the part of the ring between radius ri and ro around cx, cy
+**                          that lies sweep clockwise from angle start, segment k from
+**                          bounds[k] to bounds[k+1] (relative to start) in colors[k]. Each
+**                          row is one or two spans, cut where the segment boundary rays
+**                          cross it, and each piece is colored from the angle of its middle
+***************************************************************************************/
+void KGFX::drawRing(TFT_eSPI &dst, int cx, int cy, int ro, int ri, uint16_t start, uint32_t sweep,
+                    const uint32_t *bounds, const uint16_t *colors, int segs) {
+  int32_t rs[K_MAX_SEGMENTS+1];
+  int32_t rc[K_MAX_SEGMENTS+1];
+  for (int k=0;k<=segs;k++) {
+    uint16_t a = start + bounds[k];
+    rs[k] = kgfxSin(a);
+    rc[k] = kgfxSin(a + 16384);
+  }
+
+  for (int dy=-ro;dy<=ro;dy++) {
+    int32_t xo = kgfxSqrt(ro*ro + ro - dy*dy);
+    int32_t inner = ri*ri - ri - dy*dy;
+    int32_t xi = inner >= 0 ? kgfxSqrt(inner) : -1;
+
+    // Boundary rays pointing into this row and the column where they cross it
+    int32_t cuts[K_MAX_SEGMENTS+1];
+    int n = 0;
+    for (int k=0;k<=segs;k++) {
+      if ((int64_t)rc[k]*dy >= 0) continue;
+      int64_t num = (int64_t)dy*rs[k];
+      int64_t den = -rc[k];
+      if (den < 0) {
+        num = -num;
+        den = -den;
+      }
+      int32_t x = num >= 0 ? (num + den - 1)/den : -((-num)/den);
+      int j = n++;
+      while (j > 0 && cuts[j-1] > x) {
+        cuts[j] = cuts[j-1];
+        j--;
+      }
+      cuts[j] = x;
+    }
+
+    for (int side=0;side<2;side++) {
+      int32_t l = side ? xi + 1 : -xo;
+      int32_t r = side || xi < 0 ? xo : -xi - 1;
+      if (side && xi < 0) break;
+      if (l > r) continue;
+
+      int c = 0;
+      while (l <= r) {
+        while (c < n && cuts[c] <= l) c++;
+        int32_t e = c < n && cuts[c] <= r ? cuts[c] - 1 : r;
+
+        uint32_t rel = (uint16_t)(kgfxAngle((l + e)/2, dy) - start);
+        if (sweep >= 65536 || rel <= sweep) {
+          int k = 0;
+          while (k < segs-1 && rel >= bounds[k+1]) k++;
+          dst.drawFastHLine(cx + l, cy + dy, e - l + 1, colors[k]);
+        }
+        l = e + 1;
+      }
+    }
+  }
+}
+
+/***************************************************************************************
+** Function name:           drawDonut
+** Description:             Draws a donut chart to screen, one slice per value from 12 o'clock
+**                          clockwise, sized by the share of the value in the total. Values
+**                          past K_MAX_SEGMENTS or below zero are left out
+***************************************************************************************/
+void KGFX::drawDonut(const std::vector<float> &values, const std::vector<int> &colors, int cx, int cy,
+                     int radius, int thickness) {
+  int segs = std::min({(int)values.size(), (int)colors.size(), K_MAX_SEGMENTS});
+  float total = 0;
+  for (int k=0;k<segs;k++) {
+    if (values[k] > 0) total += values[k];
+  }
+  if (!(total > 0)) return;
+
+  uint32_t bounds[K_MAX_SEGMENTS+1];
+  uint16_t segColors[K_MAX_SEGMENTS];
+  float sum = 0;
+  bounds[0] = 0;
+  for (int k=0;k<segs;k++) {
+    if (values[k] > 0) sum += values[k];
+    bounds[k+1] = (uint32_t)(sum / total * 65536 + 0.5f);
+    segColors[k] = colors[k];
+  }
+  bounds[segs] = 65536;
+
+  drawRing(tft, cx, cy, radius, std::max(radius - thickness, 0), 0, 65536, bounds, segColors, segs);
+}
+
+/***************************************************************************************
+** Function name:           drawGauge
+** Description:             Draws a half circle gauge to screen, the arc split in equal zones
+**                          of colors from lo on the left to hi on the right and a needle at
+**                          value. The dial is kept in gaugeSpr so updateGauge only has to
+**                          redraw the needle
+***************************************************************************************/
+void KGFX::drawGauge(float value, float lo, float hi, const std::vector<int> &colors, int cx, int cy,
+                     int radius, int thickness, int needleColor) {
+  int segs = std::min((int)colors.size(), K_MAX_SEGMENTS);
+  if (segs == 0 || radius < 2) return;
+
+  gaugeLo = lo;
+  gaugeHi = hi;
+  gaugeCx = cx;
+  gaugeCy = cy;
+  gaugeHub = std::max(K_GAUGE_HUB, radius/12);
+  gaugeLength = radius - thickness/2;
+  gaugeNeedleColor = needleColor;
+  gaugeX = cx - radius;
+  gaugeY = cy - radius;
+  gaugeW = 2*radius + 1;
+  gaugeH = radius + gaugeHub + 1;
+
+  if (!gaugeSpr.created() || gaugeSpr.width() != gaugeW || gaugeSpr.height() != gaugeH) {
+    gaugeSpr.deleteSprite();
+    gaugeSpr.setColorDepth(16);
+    if (!gaugeSpr.createSprite(gaugeW, gaugeH)) {
+      Serial.println("No memory: cannot create dial sprite");
+      return;
+    }
+    gaugeLine.deleteSprite();
+    gaugeLine.setColorDepth(16);
+    if (!gaugeLine.createSprite(gaugeW, 1)) {
+      Serial.println("No memory: cannot create needle sprite");
+      gaugeSpr.deleteSprite();
+      return;
+    }
+  }
+
+  uint32_t bounds[K_MAX_SEGMENTS+1];
+  uint16_t segColors[K_MAX_SEGMENTS];
+  for (int k=0;k<=segs;k++) {
+    bounds[k] = 32768*k/segs;
+  }
+  for (int k=0;k<segs;k++) {
+    segColors[k] = colors[k];
+  }
+
+  gaugeSpr.fillSprite(TFT_BLACK);
+  drawRing(gaugeSpr, radius, radius, radius, std::max(radius - thickness, 0), 49152, 32768, bounds, segColors, segs);
+  gaugeSpr.pushSprite(gaugeX, gaugeY);
+
+  gaugeAngle = -1;
+  updateGauge(value);
+}
+
+/***************************************************************************************
+** Function name:           updateGauge
+** Description:             Moves the needle of the last drawGauge to value. Only the rows
+**                          of the old and new needle are sent, each as the span covering
+**                          both, restored from the dial in gaugeSpr with the new needle on
+**                          top
+***************************************************************************************/
+void KGFX::updateGauge(float value) {
+  if (!gaugeSpr.created()) return;
+
+  float f = (value - gaugeLo) / (gaugeHi - gaugeLo);
+  if (!(f > 0)) f = 0;
+  if (f > 1) f = 1;
+  uint16_t a = 49152 + (uint16_t)(f * 32768 + 0.5f);
+  if (a == gaugeAngle) return;
+
+  int y0, y1, o0, o1;
+  needleRows(a, y0, y1);
+  if (gaugeAngle >= 0) {
+    needleRows(gaugeAngle, o0, o1);
+    y0 = std::min(y0, o0);
+    y1 = std::max(y1, o1);
+  }
+  y0 = std::max(y0, gaugeY);
+  y1 = std::min(y1, gaugeY + gaugeH - 1);
+
+  const uint16_t *bg = (const uint16_t *)gaugeSpr.getPointer();
+  uint16_t *line = (uint16_t *)gaugeLine.getPointer();
+  for (int y=y0;y<=y1;y++) {
+    int n0, n1;
+    bool hasNew = needleSpan(a, y, n0, n1);
+    bool hasOld = gaugeAngle >= 0 && needleSpan(gaugeAngle, y, o0, o1);
+    if (!hasNew && !hasOld) continue;
+
+    int l = hasNew ? n0 : o0;
+    int r = hasNew ? n1 : o1;
+    if (hasNew && hasOld) {
+      l = std::min(l, o0);
+      r = std::max(r, o1);
+    }
+    l = std::max(l, gaugeX) - gaugeX;
+    r = std::min(r, gaugeX + gaugeW - 1) - gaugeX;
+    if (l > r) continue;
+
+    memcpy(line + l, bg + (y - gaugeY)*gaugeW + l, (r - l + 1)*sizeof(uint16_t));
+    if (hasNew) {
+      n0 = std::max(n0 - gaugeX, 0);
+      n1 = std::min(n1 - gaugeX, gaugeW - 1);
+      if (n0 <= n1) gaugeLine.drawFastHLine(n0, 0, n1 - n0 + 1, gaugeNeedleColor);
+    }
+    gaugeLine.pushSprite(gaugeX + l, y, l, 0, r - l + 1, 1);
+  }
+
+  gaugeAngle = a;
+}
+
+/***************************************************************************************
+** Function name:           deleteGauge
+** Description:             Deletes the dial and needle row sprites of the last drawGauge,
+**                          updateGauge does nothing until the next drawGauge
+***************************************************************************************/
+void KGFX::deleteGauge() {
+  gaugeSpr.deleteSprite();
+  gaugeLine.deleteSprite();
+  gaugeAngle = -1;
+}
+
+/***************************************************************************************
+** Function name:           needleTriangle
+** Description:             Corners of the needle at angle a in 1/256 pixels, the tip
+**                          gaugeLength from the center and the base across the hub
+***************************************************************************************/
+void KGFX::needleTriangle(uint16_t a, int32_t *px, int32_t *py) {
+  int32_t s = kgfxSin(a);
+  int32_t c = kgfxSin(a + 16384);
+  int32_t w = std::max(1, gaugeHub*2/3);
+
+  px[0] = gaugeCx*256 + ((gaugeLength*s) >> 6);
+  py[0] = gaugeCy*256 - ((gaugeLength*c) >> 6);
+  px[1] = gaugeCx*256 + ((w*c) >> 6);
+  py[1] = gaugeCy*256 + ((w*s) >> 6);
+  px[2] = gaugeCx*256 - ((w*c) >> 6);
+  py[2] = gaugeCy*256 - ((w*s) >> 6);
+}
+
+/***************************************************************************************
+** Function name:           needleRows
+** Description:             First and last row the needle at angle a covers
+***************************************************************************************/
+void KGFX::needleRows(uint16_t a, int &y0, int &y1) {
+  int32_t px[3], py[3];
+  needleTriangle(a, px, py);
+  y0 = std::min(gaugeCy - gaugeHub, (std::min({py[0], py[1], py[2]}) + 255) >> 8);
+  y1 = std::max(gaugeCy + gaugeHub, std::max({py[0], py[1], py[2]}) >> 8);
+}
+
+/***************************************************************************************
+** Function name:           needleSpan
+** Description:             Columns x0 to x1 the needle at angle a covers in row y, the
+**                          triangle at least one pixel wide and joined with the hub disc.
+**                          Returns false when the needle misses the row
+***************************************************************************************/
+bool KGFX::needleSpan(uint16_t a, int y, int &x0, int &x1) {
+  int32_t px[3], py[3];
+  needleTriangle(a, px, py);
+
+  int32_t yy = y*256;
+  int32_t lo = INT32_MAX;
+  int32_t hi = INT32_MIN;
+  for (int e=0;e<3;e++) {
+    int p = e;
+    int q = e == 2 ? 0 : e + 1;
+    if (yy < std::min(py[p], py[q]) || yy > std::max(py[p], py[q])) continue;
+    int32_t x = px[p];
+    if (py[q] != py[p]) x += (int64_t)(px[q] - px[p])*(yy - py[p])/(py[q] - py[p]);
+    lo = std::min(lo, x);
+    hi = std::max(hi, x);
+    if (py[q] == py[p]) {
+      lo = std::min(lo, px[q]);
+      hi = std::max(hi, px[q]);
+    }
+  }
+
+  bool hit = lo <= hi;
+  if (hit) {
+    x0 = (lo + 255) >> 8;
+    x1 = hi >> 8;
+    if (x0 > x1) x0 = x1 = (lo + hi + 256) >> 9;
+  }
+
+  int dy = y - gaugeCy;
+  if (dy >= -gaugeHub && dy <= gaugeHub) {
+    int hx = kgfxSqrt(gaugeHub*gaugeHub + gaugeHub - dy*dy);
+    x0 = hit ? std::min(x0, gaugeCx - hx) : gaugeCx - hx;
+    x1 = hit ? std::max(x1, gaugeCx + hx) : gaugeCx + hx;
+    hit = true;
+  }
+  return hit;
+}
+
+/***************************************************************************************
+** Function name:           KGFXSeries
+** Description:             Creates an empty series holding up to capacity samples
+***************************************************************************************/
+KGFXSeries::KGFXSeries(int capacity) {
+  if (capacity < 1) capacity = 1;
+  buf.resize(capacity);
+  minQueue.queue.resize(capacity);
+  maxQueue.queue.resize(capacity);
+}
+
+/***************************************************************************************
+** Function name:           push
+** Description:             Appends a sample, dropping the oldest one when full. Indicators
+**                          are updated before the sample lands, while the one leaving their
+**                          window is still held
+***************************************************************************************/
+void KGFXSeries::push(float v) {
+  int cap = buf.size();
+  updateIndicators(total, v, total - count);
+
+  if (count == cap) {
+    uint32_t oldest = total - cap;
+    extremeDrop(minQueue, oldest);
+    extremeDrop(maxQueue, oldest);
+    extremeDrop(lowerQueue, oldest);
+    extremeDrop(upperQueue, oldest);
+    head = (head + 1) % cap;
+    count--;
+  }
+
+  int pos = (head + count) % cap;
+  buf[pos] = v;
+  count++;
+  if (!logs.empty()) {
+    logs[pos] = v > 0 ? log10f(v) : NAN;
+  }
+
+  extremePush(minQueue, buf, total, false);
+  extremePush(maxQueue, buf, total, true);
+  if (bandPeriod > 0) {
+    extremePush(lowerQueue, ind[K_BAND_LOWER], total, false);
+    extremePush(upperQueue, ind[K_BAND_UPPER], total, true);
+  }
+  total++;
+}
+
+/***************************************************************************************
+** Function name:           updateIndicators
+** Description:             Updates the enabled indicators with sample seq of value v and
+**                          stores them at its ring slot. first is the oldest sample still
+**                          held, samples leaving a window are read back from the ring
+***************************************************************************************/
+void KGFXSeries::updateIndicators(uint32_t seq, float v, uint32_t first) {
+  int pos = seq % buf.size();
+  bool valid = v == v;
+
+  if (smaPeriod > 0) {
+    if (seq >= first + smaPeriod) {
+      float old = sample(seq - smaPeriod);
+      if (old == old) { smaSum -= old; smaCount--; }
+    }
+    if (valid) { smaSum += v; smaCount++; }
+    if (++smaSince >= smaPeriod && seq + 1 >= first + smaPeriod) {
+      // Resum the window, seq itself is not in the ring yet
+      smaSum = valid ? v : 0;
+      for (uint32_t i=seq+1-smaPeriod;i<seq;i++) {
+        float s = sample(i);
+        if (s == s) smaSum += s;
+      }
+      smaSince = 0;
+    }
+    ind[K_SMA][pos] = smaCount ? smaSum / smaCount : NAN;
+  }
+
+  if (emaAlpha > 0) {
+    if (valid) ema = ema == ema ? ema + emaAlpha * (v - ema) : v;
+    ind[K_EMA][pos] = ema;
+  }
+
+  if (bandPeriod > 0) {
+    if (seq >= first + bandPeriod) {
+      float old = sample(seq - bandPeriod);
+      if (old == old) {
+        bandCount--;
+        if (bandCount == 0) {
+          bandMean = bandM2 = 0;
+        } else {
+          float d = old - bandMean;
+          bandMean -= d / bandCount;
+          bandM2 -= d * (old - bandMean);
+        }
+      }
+    }
+    if (valid) {
+      bandCount++;
+      float d = v - bandMean;
+      bandMean += d / bandCount;
+      bandM2 += d * (v - bandMean);
+    }
+    if (++bandSince >= bandPeriod && seq + 1 >= first + bandPeriod) {
+      // Recompute the window in two passes, float rounding builds up in M2
+      float sum = valid ? v : 0;
+      for (uint32_t i=seq+1-bandPeriod;i<seq;i++) {
+        float s = sample(i);
+        if (s == s) sum += s;
+      }
+      bandMean = bandCount ? sum / bandCount : 0;
+      bandM2 = valid ? (v - bandMean) * (v - bandMean) : 0;
+      for (uint32_t i=seq+1-bandPeriod;i<seq;i++) {
+        float s = sample(i);
+        if (s == s) bandM2 += (s - bandMean) * (s - bandMean);
+      }
+      bandSince = 0;
+    }
+    if (bandM2 < 0) bandM2 = 0;
+    float sd = bandCount ? sqrtf(bandM2 / bandCount) : NAN;
+    ind[K_BAND_UPPER][pos] = bandCount ? bandMean + bandK * sd : NAN;
+    ind[K_BAND_LOWER][pos] = bandCount ? bandMean - bandK * sd : NAN;
+  }
+}
+
+/***************************************************************************************
+** Function name:           replay
+** Description:             Recomputes every indicator over the held samples after the
+**                          indicator settings changed, O(size) once
+***************************************************************************************/
+void KGFXSeries::replay() {
+  int cap = buf.size();
+  smaSum = 0;
+  smaCount = smaSince = 0;
+  ema = NAN;
+  bandMean = bandM2 = 0;
+  bandCount = bandSince = 0;
+  lowerQueue.head = lowerQueue.count = 0;
+  upperQueue.head = upperQueue.count = 0;
+  lowerQueue.queue.resize(bandPeriod > 0 ? cap : 0);
+  upperQueue.queue.resize(bandPeriod > 0 ? cap : 0);
+  config++;
+
+  uint32_t first = total - count;
+  for (uint32_t seq=first;seq<total;seq++) {
+    updateIndicators(seq, sample(seq), first);
+    if (bandPeriod > 0) {
+      extremePush(lowerQueue, ind[K_BAND_LOWER], seq, false);
+      extremePush(upperQueue, ind[K_BAND_UPPER], seq, true);
+    }
+  }
+}
+
+/***************************************************************************************
+** Function name:           setSMA
+** Description:             Keeps a simple moving average over period samples, drawn in
+**                          color. Period 0 turns it off
+***************************************************************************************/
+void KGFXSeries::setSMA(int period, int color) {
+  smaPeriod = std::max(0, std::min(period, capacity()));
+  ind[K_SMA].assign(smaPeriod > 0 ? capacity() : 0, NAN);
+  indColor[K_SMA] = color;
+  replay();
+}
+
+/***************************************************************************************
+** Function name:           setEMA
+** Description:             Keeps an exponential moving average with the smoothing of a
+**                          period sample average, drawn in color. Period 0 turns it off
+***************************************************************************************/
+void KGFXSeries::setEMA(int period, int color) {
+  emaAlpha = period > 0 ? 2.0f / (period + 1) : 0;
+  ind[K_EMA].assign(period > 0 ? capacity() : 0, NAN);
+  indColor[K_EMA] = color;
+  replay();
+}
+
+/***************************************************************************************
+** Function name:           setBands
+** Description:             Keeps Bollinger bands k standard deviations around the mean of
+**                          period samples, lines drawn in lineColor and the band between
+**                          them filled with fillColor at a quarter of its intensity, -1 for
+**                          no fill. Period 0 turns them off
+***************************************************************************************/
+void KGFXSeries::setBands(int period, float k, int lineColor, int fillColor) {
+  bandPeriod = std::max(0, std::min(period, capacity()));
+  bandK = k;
+  ind[K_BAND_UPPER].assign(bandPeriod > 0 ? capacity() : 0, NAN);
+  ind[K_BAND_LOWER].assign(bandPeriod > 0 ? capacity() : 0, NAN);
+  indColor[K_BAND_UPPER] = indColor[K_BAND_LOWER] = lineColor;
+  bandFillColor = fillColor;
+  replay();
+}
+
+/***************************************************************************************
+** Function name:           setLogCache
+** Description:             Keeps the log10 of every sample, taken once as it is pushed, for
+**                          log scale charts. Drawing the series on a log scale turns it on
+**                          by itself, off frees it until the next log scale chart
+***************************************************************************************/
+void KGFXSeries::setLogCache(bool on) {
+  if (!on) {
+    logs.clear();
+    logs.shrink_to_fit();
+    return;
+  }
+  fillLogs();
+}
+
+/***************************************************************************************
+** Function name:           fillLogs
+** Description:             Starts the log cache, the samples already held are converted now
+***************************************************************************************/
+void KGFXSeries::fillLogs() const {
+  if (!logs.empty()) return;
+
+  logs.assign(capacity(), NAN);
+  for (uint32_t seq=total-count;seq<total;seq++) {
+    float v = sample(seq);
+    logs[seq % buf.size()] = v > 0 ? log10f(v) : NAN;
+  }
+}
+
+/***************************************************************************************
+** Function name:           extremePush
+** Description:             Adds sample seq of ring to a min (max false) or max queue,
+**                          dropping every queued sample it dominates from the back. NaN
+**                          is never queued
+***************************************************************************************/
+void KGFXSeries::extremePush(Extreme &e, const std::vector<float> &ring, uint32_t seq, bool max) {
+  int cap = e.queue.size();
+  if (!cap) return;
+  float v = ring[seq % ring.size()];
+  if (!isfinite(v)) return;
+
+  while (e.count) {
+    float last = ring[e.queue[(e.head + e.count - 1) % cap] % ring.size()];
+    if (max ? last > v : last < v) break;
+    e.count--;
+  }
+  e.queue[(e.head + e.count) % cap] = seq;
+  e.count++;
+}
+
+/***************************************************************************************
+** Function name:           extremeDrop
+** Description:             Drops sample seq from the front of a queue when it leaves
+***************************************************************************************/
+void KGFXSeries::extremeDrop(Extreme &e, uint32_t seq) {
+  if (e.count && e.queue[e.head] == seq) {
+    e.head = (e.head + 1) % e.queue.size();
+    e.count--;
+  }
+}
+
+/***************************************************************************************
+** Function name:           extreme
+** Description:             Value at the front of a queue, none when it is empty
+***************************************************************************************/
+float KGFXSeries::extreme(const Extreme &e, const std::vector<float> &ring, float none) const {
+  return e.count ? ring[e.queue[e.head] % ring.size()] : none;
+}
+
+/***************************************************************************************
+** Function name:           clear
+** Description:             Drops every sample, indicator settings are kept
+***************************************************************************************/
+void KGFXSeries::clear() {
+  head = count = 0;
+  total = 0;
+  replay();
+  minQueue.head = minQueue.count = 0;
+  maxQueue.head = maxQueue.count = 0;
+}
+
+/***************************************************************************************
+** Function name:           indicator
+** Description:             Value of an indicator at sample i, 0 being the oldest, NaN
+**                          while it is off
+***************************************************************************************/
+float KGFXSeries::indicator(int kind, int i) const {
+  if (kind < 0 || kind >= K_INDICATORS || ind[kind].empty()) return NAN;
+  return ind[kind][(head + i) % buf.size()];
+}
+
+/***************************************************************************************
+** Function name:           min
+** Description:             Smallest held sample, INFINITY when none is a number
+***************************************************************************************/
+float KGFXSeries::min() const {
+  return extreme(minQueue, buf, INFINITY);
+}
+
+/***************************************************************************************
+** Function name:           max
+** Description:             Largest held sample, -INFINITY when none is a number
+***************************************************************************************/
+float KGFXSeries::max() const {
+  return extreme(maxQueue, buf, -INFINITY);
+}
+
+/***************************************************************************************
+** Function name:           ringSpan
+** Description:             The held entries of a ring laid out like the samples, oldest
+**                          first, without a range
+***************************************************************************************/
+KGFXSpan KGFXSeries::ringSpan(const std::vector<float> &ring) const {
+  int cap = buf.size();
+  int first = std::min(count, cap - head);
+  return KGFXSpan(ring.data() + head, first, ring.data(), count - first);
+}
+
+/***************************************************************************************
+** Function name:           span
+** Description:             The held samples, oldest first, with their range widened to the
+**                          Bollinger bands when they are on
+***************************************************************************************/
+KGFXSpan KGFXSeries::span() const {
+  KGFXSpan s = ringSpan(buf);
+  s.ranged = true;
+  s.lo = std::min(min(), extreme(lowerQueue, ind[K_BAND_LOWER], INFINITY));
+  s.hi = std::max(max(), extreme(upperQueue, ind[K_BAND_UPPER], -INFINITY));
+  return s;
+}
+
+/***************************************************************************************
+** Function name:           logSpan
+** Description:             The cached logs of the held samples, oldest first. The range is
+**                          the log of the sample range when every sample is positive
+***************************************************************************************/
+KGFXSpan KGFXSeries::logSpan() const {
+  KGFXSpan s = ringSpan(logs);
+  KGFXSpan r = span();
+  s.logged = true;
+  s.ranged = r.lo > 0 && r.lo <= r.hi;
+  if (s.ranged) {
+    s.lo = log10f(r.lo);
+    s.hi = log10f(r.hi);
+  }
+  return s;
 }
@@ -11,21 +11,390 @@
 #define K_GREEN TFT_GREEN
 #define K_RED TFT_RED
 
+#define K_ARIAL 0
+#define K_ARIAL_BOLD 1
+
+#define K_ALIGN_LEFT 0
+#define K_ALIGN_CENTER 1
+#define K_ALIGN_RIGHT 2
+
+#define K_SCALE_LINEAR 0
+#define K_SCALE_LOG 1
+#define K_SCALE_PERCENT 2
+
+#define K_MAX_TEXT_LINES 8
+
+#define K_ROW_MISSING INT32_MIN // chart row of a NaN or infinite sample
+
+#define K_CHART_LINE 3     // chart line thickness in rows
+#define K_CHART_AA_LEVELS 8 // coverage levels blended at the line edges
+#define K_MAX_SERIES 4      // series drawChartOverlay plots in one chart
+#define K_MAX_OVERLAYS 4    // lines drawn over the primary one, overlay series or indicators
+#define K_MAX_TICKS 8       // y-axis ticks setChartAxis may ask for
+#define K_GRID_DOT 4        // columns between the dots of a gridline
+#define K_SPARK_GAP 2       // pixels between sparkline cells
+#define K_DIRTY_GAP 8       // clean columns between changed runs sent in one window
+#define K_BAND_ROWS 16      // rows per band of drawChartBanded
+#define K_MAX_SEGMENTS 16   // zones of a gauge or slices of a donut
+#define K_GAUGE_HUB 3       // smallest radius of the gauge needle hub
+
+#define K_SHADES 14          // gradient shades following the line color in a chart palette
+#define K_SHADE_CACHE 4      // generated shade ramps kept by createPalette
+#define K_CHART_RANGES 8     // chart lines whose last y-range is kept for auto-range
+
+// Gradient shade scales in 1/256. Lightness (L* ~ Y^1/3) is evenly spaced from 46% to 5%
+// of the base color and converted to gamma encoded channels with an exponent of 3/2.2
+static constexpr uint8_t K_SHADE_SCALE[K_SHADES] = {89, 81, 73, 65, 57, 50, 43, 36, 30, 24, 18, 13, 8, 4};
+
+// Gradient shade i (0 to K_SHADES-1) of an RGB565 color, usable in constant expressions
+constexpr uint16_t kgfxShade(uint16_t color, int i) {
+  return (uint16_t)(((((color >> 11) & 0x1F) * K_SHADE_SCALE[i] + 128) >> 8) << 11
+                  | ((((color >> 5) & 0x3F) * K_SHADE_SCALE[i] + 128) >> 8) << 5
+                  | (((color & 0x1F) * K_SHADE_SCALE[i] + 128) >> 8));
+}
+
+// Samples of a chart series, oldest first, in up to two contiguous parts so ring
+// buffers are read through the wrap without copying. ranged is set when the source
+// keeps the min/max of its samples in lo/hi, logged when they are already log10
+struct KGFXSpan {
+  const float *a;
+  int na;
+  const float *b;
+  int nb;
+  bool ranged;
+  float lo;
+  float hi;
+  bool logged;
+
+  KGFXSpan(const std::vector<float> &v)
+    : a(v.data()), na(v.size()), b(nullptr), nb(0), ranged(false), lo(0), hi(0), logged(false) {}
+  KGFXSpan(const float *a, int na, const float *b, int nb)
+    : a(a), na(na), b(b), nb(nb), ranged(false), lo(0), hi(0), logged(false) {}
+
+  int size() const { return na + nb; }
+  float operator[](int i) const { return i < na ? a[i] : b[i - na]; }
+};
+
+// Indicators a KGFXSeries can keep alongside its samples
+#define K_SMA 0
+#define K_EMA 1
+#define K_BAND_UPPER 2
+#define K_BAND_LOWER 3
+#define K_INDICATORS 4
+
+// Fixed capacity chart series. push() is O(1), once full the oldest sample is
+// dropped. The min/max of the held samples is kept up to date with monotonic
+// queues of sample numbers, NaN samples are held but left out of the range.
+// Enabled indicators are updated per sample in O(1) and held in rings of the
+// same layout, Bollinger bands widen the range to fit
+class KGFXSeries {
+  friend class KGFX;
+
+  private:
+    std::vector<float> buf;
+    int head = 0;
+    int count = 0;
+    uint32_t total = 0;
+
+    // Sample numbers of the candidates for an extreme of a ring, oldest first
+    struct Extreme {
+      std::vector<uint32_t> queue;
+      int head = 0;
+      int count = 0;
+    };
+    Extreme minQueue, maxQueue, lowerQueue, upperQueue;
+
+    // Indicator rings, empty while an indicator is off, and their colors
+    std::vector<float> ind[K_INDICATORS];
+    int indColor[K_INDICATORS] = {-1, -1, -1, -1};
+
+    // log10 of every sample, NaN for those not positive, empty until a log scale
+    // chart or setLogCache starts it
+    mutable std::vector<float> logs;
+    int bandFillColor = -1;
+    uint32_t config = 0;
+
+    // SMA running sum over the window, resummed every period samples against drift
+    int smaPeriod = 0;
+    float smaSum = 0;
+    int smaCount = 0;
+    int smaSince = 0;
+
+    // EMA smoothing factor 2/(period+1), NaN until the first sample
+    float emaAlpha = 0;
+    float ema = NAN;
+
+    // Welford mean and sum of squared deviations over the band window, recomputed
+    // every period samples
+    int bandPeriod = 0;
+    float bandK = 2;
+    float bandMean = 0;
+    float bandM2 = 0;
+    int bandCount = 0;
+    int bandSince = 0;
+
+    float sample(uint32_t seq) const { return buf[seq % buf.size()]; }
+    void extremePush(Extreme &e, const std::vector<float> &ring, uint32_t seq, bool max);
+    void extremeDrop(Extreme &e, uint32_t seq);
+    float extreme(const Extreme &e, const std::vector<float> &ring, float none) const;
+    void updateIndicators(uint32_t seq, float v, uint32_t first);
+    void replay();
+    KGFXSpan ringSpan(const std::vector<float> &ring) const;
+    KGFXSpan logSpan() const;
+    void fillLogs() const;
+
+  public:
+    explicit KGFXSeries(int capacity);
+
+    void push(float v);
+    void clear();
+
+    void setSMA(int period, int color);
+    void setEMA(int period, int color);
+    void setBands(int period, float k, int lineColor, int fillColor);
+    void setLogCache(bool on);
+
+    int size() const { return count; }
+    int capacity() const { return buf.size(); }
+    uint32_t pushed() const { return total; }
+    float operator[](int i) const { return buf[(head + i) % buf.size()]; }
+    float indicator(int kind, int i) const;
+    float min() const;
+    float max() const;
+    KGFXSpan span() const;
+};
+
 class KGFX {
   private:
     TFT_eSPI t = TFT_eSPI();
 
-    uint16_t red_palette[15] =  {K_RED, 0x5000, 0x5000, 0x4800, 0x4800, 0x4000, 0x4000, 0x3800, 0x3800, 0x3000, 0x3000, 0x2800, 0x2000};
+    uint16_t red_palette[15] =  {K_RED, 0x5000, 0x5000, 0x4800, 0x4800, 0x4000, 0x4000, 0x3800, 0x3800, 0x3000, 0x3000, 0x2800, 0x2000, 0x1800, 0x1000};
     uint16_t green_palette[15] =  {K_GREEN, 0x02C0, 0x0240, 0x0200, 0x01C0, 0x0180, 0x0140, 0x0100, 0x00E0, 0x00C0, 0x00A0, 0x0080, 0x0060, 0x0040, 0x0020};
     uint16_t palette[16];
 
-    int chartLen = 30;
-    int fa[30];
+    // Shade ramps generated for colors other than K_GREEN and K_RED, reused round robin
+    int shadeCacheColor[K_SHADE_CACHE] = {-1, -1, -1, -1};
+    uint16_t shadeCache[K_SHADE_CACHE][K_SHADES];
+    int shadeCacheNext = 0;
+
+    // Per family glyph advances for every size of the Arial ladders, built on first use
+    std::vector<uint8_t> fontAdvances[2];
+
+    // Plotted points of the last formatted series in chart sprite coordinates, in
+    // time order, and the sample index each point came from. Decimated series have
+    // up to two points per two column bucket, its min and max, which can share a column
+    std::vector<int32_t> chartIdx;
+    std::vector<int16_t> chartX;
+    std::vector<int32_t> chartY; // rows in 1/256 pixel
+
+    // Points of the lines drawn over the primary one, overlay series or indicators,
+    // overlay k spans overlayStart[k] to overlayStart[k+1] and is drawn in palette[15-k]
+    int overlays = 0;
+    int overlayStart[K_MAX_OVERLAYS+1];
+    int overlayColor[K_MAX_OVERLAYS];
+    std::vector<int32_t> overlayIdx;
+    std::vector<int16_t> overlayX;
+    std::vector<int32_t> overlayY;
+
+    // Bollinger band fill between overlays chartBand and chartBand+1, drawn in
+    // palette[15-overlays] under the lines, -1 without a fill
+    int chartBand = -1;
+    int chartBandFill = -1;
+
+    // Series whose indicators the chart in chartSpr shows, and its settings count
+    const KGFXSeries *chartSeries = nullptr;
+    uint32_t chartSeriesConfig = 0;
+
+    // Y-axis ticks of the chart in chartSpr, row of each gridline and the left/top
+    // of its label. Dots are drawn where x % K_GRID_DOT is 0
+    int chartAxisTicks = 0;
+    int axisTicks = 0;
+    int16_t axisRow[K_MAX_TICKS];
+    int16_t axisLabelX[K_MAX_TICKS];
+    int16_t axisLabelY[K_MAX_TICKS];
+    int axisLeft = 0;
+
+    // Tick label bitmap as vertical spans, rendered once per label text. The spans
+    // of column x are spans[colStart[x]] up to spans[colStart[x+1]], as row pairs
+    struct AxisLabel {
+      char text[16];
+      int16_t width;
+      int16_t height;
+      std::vector<uint16_t> colStart;
+      std::vector<uint8_t> spans;
+    };
+    std::vector<AxisLabel> axisLabels;
+    int axisLabelRenders = 0;
+
+    // Range and layout the ticks were last placed for, kept while these stay the same
+    float axisKeyLo = NAN;
+    float axisKeyHi = NAN;
+    float axisKeyBase = NAN;
+    int axisKeyRows = 0;
+    int axisKeyScale = -1;
+    int axisKeyTicks = 0;
+    int axisKeyWidth = 0;
+    int axisKeyHeight = 0;
+
+    // Points of every sparkline of the last drawSparklines, series k spans
+    // sparkStart[k] to sparkStart[k+1]
+    std::vector<int32_t> sparkIdx;
+    std::vector<int16_t> sparkX;
+    std::vector<int32_t> sparkY;
+    std::vector<int32_t> sparkStart;
+
+    // Columns written since the last chart push and its position, pushChart only
+    // sends the dirty columns
+    std::vector<bool> chartDirty;
+    int chartPushY = -1;
+    uint16_t chartPushPalette[16];
+
+    // Range each line of a chart was last drawn with, line 0 its primary series and
+    // k overlay k drawn on its own range, keyed by the screen row of the chart. An
+    // auto-range is held until the data leaves it or needs less than 1/(1+autoHysteresis)
+    // of it. chartRescaled tells whether the last formatted chart changed range
+    struct ChartRange {
+      int y = INT32_MIN;
+      int line = 0;
+      int scale = -1;
+      bool held = false;
+      float lo = 0;
+      float hi = 0;
+      int rows = 0;
+    };
+    ChartRange chartRanges[K_CHART_RANGES];
+    int chartRangeNext = 0;
+    bool autoRange = false;
+    float autoHeadroom = 0;
+    float autoHysteresis = 0;
+    bool chartRescaled = false;
+
+    // Value scale of line charts, the scale of the chart in chartSpr and the base
+    // sample percent charts are labelled against
+    int chartScale = K_SCALE_LINEAR;
+    int chartScaleDrawn = K_SCALE_LINEAR;
+    float chartBase = NAN;
+
+    // Sprite the chart rasterizer writes to, chartSpr or bandSpr. Chart row r lands in
+    // target row r - chartTargetTop, chartViewRows is the chart height when banded
+    TFT_eSprite *chartTarget = &chartSpr;
+    int chartTargetTop = 0;
+    int chartViewRows = 0;
+
+    // Chart rows chartVSpan and chartVCopy write, all but while only the gridline
+    // rows of scrolled columns are redrawn
+    int chartClipTop = 0;
+    int chartClipBottom = INT32_MAX;
+
+    // First row below the plotted line in each sprite column, -1 where there is no line
+    std::vector<int16_t> chartBottom;
+
+    // Line color blended over each palette entry per coverage level, as chartColor() values
+    uint16_t chartBlend[K_CHART_AA_LEVELS+1][16];
+
+    // Gradient column template in sprite buffer format, one entry per sprite row,
+    // rebuilt only when the palette, band height or sprite changes
+    std::vector<uint16_t> gradColumn;
+    uint16_t gradPalette[16];
+    int gradMulti = -1;
+    int gradDepth = -1;
+    int gradMax = -1;
+    int gradMaxIndex = 15;
+
+    // Candles merged to fit the chart width, open/high/low/close per candle
+    std::vector<float> candles;
+
+    // Bars currently in the chart sprite, merged to fit the chart width
+    std::vector<float> bars;
+    int barSpacing = 0;
+    int barHeight = 0;
+    int barY = 0;
+    int barSprWidth = 0;
+    int barSprHeight = 0;
+    int barSprDepth = 0;
+
+    // Normalization and layout of the chart currently in chartSpr, drawChartAppend
+    // only redraws incrementally while these stay the same
+    int chartSamples = 0;
+    float chartHi = 0;
+    float chartLo = 0;
+    int chartRows = 0;
+    float chartRowScale = 0;
+    bool chartSpaced = false;
+    int chartLineColor = -1;
+    int chartSpacing = 0;
+    int chartHeight = 0;
+    int chartSprWidth = 0;
+    int chartSprHeight = 0;
+    int chartSprDepth = 0;
+
+    // Gauge of the last drawGauge, the dial lives in gaugeSpr. gaugeAngle is the
+    // needle angle on screen, -1 before the first one
+    float gaugeLo = 0;
+    float gaugeHi = 0;
+    int gaugeCx = 0;
+    int gaugeCy = 0;
+    int gaugeHub = 0;
+    int gaugeLength = 0;
+    int gaugeNeedleColor = 0;
+    int gaugeX = 0;
+    int gaugeY = 0;
+    int gaugeW = 0;
+    int gaugeH = 0;
+    int gaugeAngle = -1;
+
+    void setChartRange(float lo, float hi, int rows);
+    bool fitChartRange(int y, int line, float lo, float hi, int rows);
+    void fitAutoRange(const ChartRange *held, float &lo, float &hi);
+    void drawBar(int b);
+    int chartLineRows(int height);
+    int32_t chartRow(float v);
+    int fmtChartArray(const KGFXSpan &arr, int y, int spacing=7, int height=80,
+                      float coverLo=INFINITY, float coverHi=-INFINITY);
+    void decimateChart(const KGFXSpan &arr, std::vector<int32_t> &idx, int width=0);
+    void chartMinMax(const KGFXSpan &arr, const int32_t *idx, int m, float &lo, float &hi);
+    void chartValueRange(const KGFXSpan &arr, const int32_t *idx, int m, bool logs, float &lo, float &hi);
+    void mapChartPoints(const KGFXSpan &arr, const int32_t *idx, int m, int spacing,
+                        std::vector<int16_t> &xs, std::vector<int32_t> &ys, int width=0, bool logs=false);
+    bool lineColumn(const int16_t *xs, const int32_t *ys, int n, int x, int &seg, int32_t &top, int32_t &bot);
+    void renderChart(int color, int height);
+    void pushChart(int y);
+    void markChartDirty(int x0, int x1);
+    void drawChartBandedSpan(const KGFXSpan &arr, int color, int y, int spacing, int height, int band,
+                             const KGFXSeries *series=nullptr);
+    void addIndicators(const KGFXSeries &series, int spacing);
+    KGFXSpan seriesSpan(const KGFXSeries &series);
+    int chartViewHeight();
+    void drawChartSpan(const KGFXSpan &arr, int color, int y, int spacing, int height,
+                       const KGFXSeries *series=nullptr);
+    bool drawChartAppendSpan(const KGFXSpan &arr, int color, int y, int spacing, int height,
+                             const KGFXSeries *series=nullptr);
+    void drawChartColumns(int x0, int x1, int height);
+    void drawOverlayColumn(int x, int *seg);
+    void drawGridColumn(int x, int r0, int r1, int height, int multi);
+    void drawBandColumn(int x, int r0, int r1, int height, int multi, int *seg);
+    void drawLabelColumn(int x);
+    void updateChartAxis();
+    void renderAxisLabel(AxisLabel &label);
+    void chartVSpan(int x, int y0, int y1, uint32_t c);
+    void chartVCopy(int x, int y0, int y1, const uint16_t *col);
+    uint16_t chartNative(uint32_t c);
+    const uint16_t *gradientColumn(int multi);
+    int gradientIndex(int row, int multi);
+    void createBlendTable();
+    void scrollChart(int dx);
+    void printLines(const char *txt, int areaWidth, int y, int align);
+    const tftfont_t &fitFontLadder(const char *txt, int maxWidth, int maxHeight,
+                                   const tftfont_t *const *ladder, std::vector<uint8_t> &adv);
+    void drawRing(TFT_eSPI &dst, int cx, int cy, int ro, int ri, uint16_t start, uint32_t sweep,
+                  const uint32_t *bounds, const uint16_t *colors, int segs);
+    void needleTriangle(uint16_t a, int32_t *px, int32_t *py);
+    void needleRows(uint16_t a, int &y0, int &y1);
+    bool needleSpan(uint16_t a, int y, int &x0, int &x1);
 
-    int* fmtChartArray(std::vector<float> arr, int height=80);
     void createPalette(int color);
-    void drawVGradient(int x, int y, int y1=5);
-    void drawGraphLine(int x, int y, int x1, int y1, int color);
+    const uint16_t *shadeRamp(int color);
+    uint32_t chartColor(int idx);
 
   public:
     void init();
@@ -35,21 +404,73 @@ class KGFX {
 
     TFT_eSprite chartSpr = TFT_eSprite(&tft);
 
+    // Strip buffer of drawChartBanded, kept between calls until deleteBandSprite
+    TFT_eSprite bandSpr = TFT_eSprite(&tft);
+
+    // Dial of the last drawGauge without its needle, and the row the needle is redrawn in,
+    // kept until deleteGauge
+    TFT_eSprite gaugeSpr = TFT_eSprite(&tft);
+    TFT_eSprite gaugeLine = TFT_eSprite(&tft);
+
     TFT_eSprite createSprite(int width, int height);
     TFT_eSprite createSpriteLarge(int width, int height);
 
     void createChartSprite();
     void createChartSpriteLarge(int x, int y);
+    void createChartSpritePalette(int x=240, int y=80);
+    void invalidateChart();
+
+    TFT_eSprite createTextSprite(const char *txt, const tftfont_t &f);
+
+    const tftfont_t &fitFont(const char *txt, int maxWidth, int maxHeight);
+    const tftfont_t &fitFontBold(const char *txt, int maxWidth, int maxHeight);
+
+    // The bold branch, and with it the _Bold tables, is only kept where family is not
+    // a constant K_ARIAL
+    const tftfont_t &fitFont(const char *txt, int maxWidth, int maxHeight, int family) {
+      return family == K_ARIAL_BOLD ? fitFontBold(txt, maxWidth, maxHeight) : fitFont(txt, maxWidth, maxHeight);
+    }
 
     void drawText(TFT_eSprite &spr, const char *txt, const tftfont_t &f, int color, int x, int y);
+    void drawTextTight(TFT_eSprite &spr, const char *txt, const tftfont_t &f, int color, int x, int y);
     void drawTextCenter(TFT_eSprite &spr, const char *txt, const tftfont_t &f, int color, int y);
     void drawText(const char *txt, const tftfont_t &f, int color, int x, int y);
     void drawTextCenter(const char *txt, const tftfont_t &f, int color, int y);
+    void drawTextLines(TFT_eSprite &spr, const char *txt, const tftfont_t &f, int color, int y, int align=K_ALIGN_CENTER);
+    void drawTextLines(const char *txt, const tftfont_t &f, int color, int y, int align=K_ALIGN_CENTER);
 
     void deleteSprite(TFT_eSprite &spr);
     void deleteChartSprite();
+    void deleteBandSprite();
 
-    void drawChart(std::vector<float> arr, int color, int y, int spacing=7, int height=80);
-    void drawChartWide(std::vector<float> arr, int color, int y);
-    void drawChartLarge(std::vector<float> arr, int color, int y, int height=120);
+    void drawChart(const std::vector<float> &arr, int color, int y, int spacing=7, int height=80);
+    void drawChart(const KGFXSeries &series, int color, int y, int spacing=7, int height=80);
+    void drawChartWide(const std::vector<float> &arr, int color, int y);
+    void drawChartLarge(const std::vector<float> &arr, int color, int y, int height=120);
+    void drawChartBanded(const std::vector<float> &arr, int color, int y, int spacing=7, int height=80,
+                         int band=K_BAND_ROWS);
+    void drawChartBanded(const KGFXSeries &series, int color, int y, int spacing=7, int height=80,
+                         int band=K_BAND_ROWS);
+    bool drawChartAppend(const std::vector<float> &arr, int color, int y, int spacing=7, int height=80);
+    bool drawChartAppend(const KGFXSeries &series, int color, int y, int spacing=7, int height=80);
+    void setChartAxis(int ticks);
+    void setChartScale(int scale);
+    void setChartAutoRange(bool on, float headroom=0.1f, float hysteresis=0.5f);
+    bool chartRangeChanged();
+    void drawSparklines(const std::vector<std::vector<float>> &series, int color, int y, int cols,
+                        bool gradient=false);
+    void drawChartOverlay(const std::vector<std::vector<float>> &series, const std::vector<int> &colors,
+                          int y, bool sharedRange=true, int spacing=7, int height=80);
+    void drawCandles(const std::vector<float> &open, const std::vector<float> &high,
+                     const std::vector<float> &low, const std::vector<float> &close,
+                     int y, int spacing=4, int height=80);
+    void drawBars(const std::vector<float> &arr, int y, int spacing=4, int height=80,
+                  int posColor=K_GREEN, int negColor=K_RED);
+    void updateLastBar(float v);
+    void drawGauge(float value, float lo, float hi, const std::vector<int> &colors, int cx, int cy,
+                   int radius=60, int thickness=12, int needleColor=TFT_WHITE);
+    void updateGauge(float value);
+    void deleteGauge();
+    void drawDonut(const std::vector<float> &values, const std::vector<int> &colors, int cx, int cy,
+                   int radius=60, int thickness=16);
 };
\ No newline at end of file